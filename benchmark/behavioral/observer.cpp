@@ -0,0 +1,496 @@
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "behavioral/observer.hpp"
+
+namespace dpb = design_patterns::behavioral;
+
+
+struct tick {
+    long price;
+};
+
+class tick_observer : public dpb::observer<tick> {
+public:
+    long total = 0;
+    void handle(tick& notification) override { total += notification.price; }
+};
+
+/**
+ * The previous observable: a vector of weak pointers scanned to add and
+ * remove observers, locked for every notified observer
+ */
+template <typename _TObserver>
+class vector_observable {
+public:
+    void add_observer(std::shared_ptr<_TObserver>& observer)
+    {
+        for (const auto& o : observers)
+            if (o.lock()==observer)
+                return;
+        observers.push_back(observer);
+    }
+
+    void remove_observer(const std::weak_ptr<_TObserver>& observer)
+    {
+        for (auto it = observers.begin(); it!=observers.end(); ++it) {
+            if (it->lock()==observer.lock()) {
+                observers.erase(it);
+                return;
+            }
+        }
+    }
+
+    template<typename _NotificationType>
+    void notify(_NotificationType& notification)
+    {
+        auto it = observers.begin();
+        while (it!=observers.end()) {
+            if (auto ptr = it->lock()) {
+                ptr->handle(notification);
+                it++;
+            } else {
+                it = observers.erase(it);
+            }
+        }
+    }
+
+private:
+    std::vector<std::weak_ptr<_TObserver>> observers;
+};
+
+std::vector<std::shared_ptr<tick_observer>> make_observers(std::size_t count)
+{
+    std::vector<std::shared_ptr<tick_observer>> observers;
+    for (std::size_t i = 0; i<count; ++i)
+        observers.push_back(dpb::make_observer<tick_observer>());
+    return observers;
+}
+
+/**
+ * Notify a number of observers, and remove and add back one of them.
+ * Notify is reported per observer.
+ */
+void bench_observable(std::size_t count, std::size_t iterations)
+{
+    auto observers = make_observers(count);
+    vector_observable<tick_observer> old;
+    dpb::observable<tick_observer> slots;
+    std::vector<dpb::subscription> subs;
+    for (auto& o : observers) {
+        old.add_observer(o);
+        subs.push_back(slots.add_observer(o));
+    }
+
+    tick t{1};
+    double old_ns = benchmark::ns_per_op(iterations, [&]() { old.notify(t); });
+    double slots_ns = benchmark::ns_per_op(iterations, [&]() {
+      slots.notify(t);
+    });
+    std::size_t n = 0;
+    double old_churn_ns = benchmark::ns_per_op(iterations, [&]() {
+      auto& o = observers[(n++*7919)%count];
+      old.remove_observer(o);
+      old.add_observer(o);
+    });
+    n = 0;
+    double slots_churn_ns = benchmark::ns_per_op(iterations, [&]() {
+      const std::size_t i = (n++*7919)%count;
+      slots.remove_observer(subs[i]);
+      subs[i] = slots.add_observer(observers[i]);
+    });
+    benchmark::report("notify (vector of weak_ptr)", count, old_ns/count);
+    benchmark::report("notify (slot map)", count, slots_ns/count);
+    benchmark::report("remove+add (vector of weak_ptr)", count, old_churn_ns);
+    benchmark::report("remove+add (slot map)", count, slots_churn_ns);
+}
+
+struct timed_tick {
+    std::chrono::steady_clock::time_point sent;
+};
+
+/// Measures the latency from notify to handle, from one dispatcher
+class latency_observer : public dpb::observer<timed_tick> {
+public:
+    double total_ns = 0;
+    std::size_t count = 0;
+    void handle(timed_tick& notification) override
+    {
+        total_ns += std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now()-notification.sent).count();
+        count++;
+    }
+};
+
+/**
+ * Notify from a number of producer threads through an async_observable
+ * with one dispatcher: throughput of the producers until flushed, and
+ * mean latency from notify to handle
+ */
+void bench_async(std::size_t producers, std::size_t iterations,
+                 dpb::backpressure policy, const char* name)
+{
+    auto observer = dpb::make_observer<latency_observer>();
+    double ops;
+    std::size_t dropped;
+    {
+        dpb::async_observable<latency_observer> observable(4096, 1, policy);
+        observable.add_observer(observer);
+        auto start = std::chrono::steady_clock::now();
+        benchmark::ops_per_sec(producers, iterations, [&]() {
+          observable.notify(timed_tick{std::chrono::steady_clock::now()});
+        });
+        observable.flush();
+        ops = producers*iterations/std::chrono::duration<double>(
+                std::chrono::steady_clock::now()-start).count();
+        dropped = observable.dropped();
+    }
+    const std::string suffix = std::string(" (")+name+")";
+    benchmark::report("async notify"+suffix, producers, ops, "ops/s");
+    benchmark::report("async latency"+suffix, producers,
+            observer->count ? observer->total_ns/observer->count : 0);
+    benchmark::report("async dropped"+suffix, producers,
+            double(dropped)/(producers*iterations)*100, "%");
+}
+
+/**
+ * The previous observable guarded by a mutex, the baseline of
+ * concurrent_observable: observers are locked while notified, as they
+ * may be destroyed by other threads
+ */
+template <typename _TObserver>
+class locked_observable {
+public:
+    void add_observer(std::shared_ptr<_TObserver>& observer)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        observers.add_observer(observer);
+    }
+
+    void remove_observer(const std::weak_ptr<_TObserver>& observer)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        observers.remove_observer(observer);
+    }
+
+    template<typename _NotificationType>
+    void notify(_NotificationType& notification)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        observers.notify(notification);
+    }
+
+private:
+    std::mutex mtx;
+    vector_observable<_TObserver> observers;
+};
+
+class atomic_tick_observer : public dpb::observer<tick> {
+public:
+    std::atomic<long> total{0};
+    void handle(tick& notification) override
+    {
+        total.fetch_add(notification.price, std::memory_order_relaxed);
+    }
+};
+
+/**
+ * Notify a number of observers from a number of threads while another
+ * thread subscribes and unsubscribes an observer every 50us
+ */
+template<class Observable>
+void bench_churn(const char* name, std::size_t threads,
+                 std::size_t iterations, std::size_t count = 100)
+{
+    Observable observable;
+    std::vector<std::shared_ptr<atomic_tick_observer>> observers;
+    for (std::size_t i = 0; i<count; ++i) {
+        observers.push_back(dpb::make_observer<atomic_tick_observer>());
+        observable.add_observer(observers.back());
+    }
+    std::atomic<bool> done{false};
+    std::atomic<std::size_t> changes{0};
+    std::thread churn([&]() {
+      auto transient = dpb::make_observer<atomic_tick_observer>();
+      while (!done) {
+          observable.add_observer(transient);
+          observable.remove_observer(transient);
+          changes++;
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+      }
+    });
+    double ops = benchmark::ops_per_sec(threads, iterations, [&]() {
+      tick t{1};
+      observable.notify(t);
+    });
+    done = true;
+    churn.join();
+    benchmark::report(std::string("notify with churn (")+name+")", threads,
+            ops, "ops/s");
+}
+
+/// Handler doing about a microsecond of work
+class busy_tick_observer : public dpb::observer<tick> {
+public:
+    double total = 0;
+    void handle(tick& notification) override
+    {
+        double x = double(notification.price);
+        for (int i = 0; i<200; ++i)
+            x = x*1.000001+0.5;
+        total += x;
+    }
+};
+
+/**
+ * Notify a number of observers serially and from a pool of workers, the
+ * default chunks, from 1 worker to all cores and 4. Reported per observer.
+ */
+template<class _TObserver>
+void bench_parallel(const char* name, std::size_t count,
+                    std::size_t iterations)
+{
+    std::vector<std::shared_ptr<_TObserver>> observers;
+    dpb::observable<_TObserver> observable;
+    for (std::size_t i = 0; i<count; ++i) {
+        observers.push_back(dpb::make_observer<_TObserver>());
+        observable.add_observer(observers.back());
+    }
+    tick t{1};
+    const std::string suffix = std::string(" (")+name+")";
+    double serial_ns = benchmark::ns_per_op(iterations, [&]() {
+      observable.notify(t);
+    });
+    benchmark::report("notify"+suffix, count, serial_ns/count);
+    const std::size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::size_t> counts{1, cores, 4};
+    std::sort(counts.begin(), counts.end());
+    counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+    for (std::size_t workers : counts) {
+        design_patterns::work_stealing_pool pool(workers);
+        double ns = benchmark::ns_per_op(iterations, [&]() {
+          observable.notify_parallel(pool, t);
+        });
+        benchmark::report("notify_parallel"+suffix+" "+
+                std::to_string(workers)+" workers", count, ns/count);
+    }
+}
+
+template<int I>
+struct event {
+    long value;
+};
+
+template<class Sequence>
+struct events_of;
+
+template<int... I>
+struct events_of<std::integer_sequence<int, I...>> {
+    typedef dpb::observer<event<I>...> observer_type;
+    typedef dpb::topic_observable<event<I>...> topic_type;
+
+    /// Call fn with an event<I>, for every I
+    template<class Fn>
+    static void for_each(Fn&& fn)
+    {
+        (fn(event<I>{I}), ...);
+    }
+
+    /// Call fn with a default event<I>, for the I-th type
+    template<class Fn>
+    static void at(int index, Fn&& fn)
+    {
+        ((index==I ? fn(event<I>{}) : void()), ...);
+    }
+};
+
+typedef events_of<std::make_integer_sequence<int, 20>> events;
+
+/// Implements handle for all events from I, and sums the interesting ones
+template<int I, int Last>
+class interested_observer : public interested_observer<I+1, Last> {
+public:
+    void handle(event<I>& notification) override
+    {
+        if (this->interest==I)
+            this->total += notification.value;
+    }
+};
+
+template<int Last>
+class interested_observer<Last, Last> : public events::observer_type {
+public:
+    int interest = 0;
+    long total = 0;
+};
+
+/// Sums the events it subscribed to
+class event_observer {
+public:
+    long total = 0;
+    template<int I>
+    void handle(event<I>& notification) { total += notification.value; }
+};
+
+/**
+ * Notify 20 notification types, each one of interest to a number of
+ * observers: an observable notifying every observer of every type, and
+ * a topic_observable notifying subscribers per type, without and with a
+ * filter accepting 1 in 10 notifications. Reported per notify.
+ */
+void bench_topics(std::size_t per_type, std::size_t iterations)
+{
+    const std::size_t count = per_type*20;
+    dpb::observable<events::observer_type> all;
+    std::vector<std::shared_ptr<interested_observer<0, 20>>> interested;
+    events::topic_type topics;
+    events::topic_type filtered;
+    std::vector<std::shared_ptr<event_observer>> observers;
+    for (std::size_t i = 0; i<count; ++i) {
+        interested.push_back(
+                dpb::make_observer<interested_observer<0, 20>>());
+        interested.back()->interest = int(i%20);
+        all.add_observer(interested.back());
+        observers.push_back(dpb::make_observer<event_observer>());
+        const long key = long(i/20%10);
+        events::at(int(i%20), [&](auto e) {
+          typedef decltype(e) event_type;
+          topics.subscribe<event_type>(observers.back());
+          filtered.subscribe<event_type>(observers.back(),
+                  [key](const event_type& notification) {
+                    return notification.value%10==key;
+                  });
+        });
+    }
+    auto notify_all = [](auto& observable) {
+      events::for_each([&](auto e) { observable.notify(e); });
+    };
+    double all_ns = benchmark::ns_per_op(iterations, [&]() {
+      notify_all(all);
+    });
+    double topic_ns = benchmark::ns_per_op(iterations, [&]() {
+      notify_all(topics);
+    });
+    double filtered_ns = benchmark::ns_per_op(iterations, [&]() {
+      notify_all(filtered);
+    });
+    benchmark::report("notify 1 of 20 types (all observers)", count,
+            all_ns/20);
+    benchmark::report("notify 1 of 20 types (topics)", count, topic_ns/20);
+    benchmark::report("notify 1 of 20 types (topics, filter)", count,
+            filtered_ns/20);
+}
+
+/// Sums batches in one loop
+class batch_tick_observer : public tick_observer {
+public:
+    void handle_batch(tick* notifications, std::size_t count) override
+    {
+        long sum = 0;
+        for (std::size_t i = 0; i<count; ++i)
+            sum += notifications[i].price;
+        total += sum;
+    }
+};
+
+struct symbol_tick {
+    int symbol;
+    long price;
+};
+
+class symbol_tick_observer : public dpb::observer<symbol_tick> {
+public:
+    long total = 0;
+    void handle(symbol_tick& notification) override
+    {
+        total += notification.price;
+    }
+};
+
+/**
+ * Deliver runs of ticks to 100 observers: notify per tick, notify_batch
+ * with the default and a batch handle_batch, and coalescing ticks of 16
+ * symbols before a flush. Reported per tick.
+ */
+void bench_batch(std::size_t batch, std::size_t iterations)
+{
+    const std::size_t count = 100;
+    auto observers = make_observers(count);
+    std::vector<std::shared_ptr<batch_tick_observer>> batch_observers;
+    dpb::observable<tick_observer> single;
+    dpb::observable<batch_tick_observer> batched;
+    std::vector<std::shared_ptr<symbol_tick_observer>> symbol_observers;
+    dpb::observable<symbol_tick_observer> symbols;
+    for (std::size_t i = 0; i<count; ++i) {
+        single.add_observer(observers[i]);
+        batch_observers.push_back(dpb::make_observer<batch_tick_observer>());
+        batched.add_observer(batch_observers.back());
+        symbol_observers.push_back(
+                dpb::make_observer<symbol_tick_observer>());
+        symbols.add_observer(symbol_observers.back());
+    }
+    std::vector<tick> ticks(batch, tick{1});
+
+    double single_ns = benchmark::ns_per_op(iterations, [&]() {
+      for (auto& t : ticks)
+          single.notify(t);
+    });
+    double default_ns = benchmark::ns_per_op(iterations, [&]() {
+      single.notify_batch(ticks.data(), ticks.size());
+    });
+    double batch_ns = benchmark::ns_per_op(iterations, [&]() {
+      batched.notify_batch(ticks.data(), ticks.size());
+    });
+    dpb::coalescing_notifier<symbol_tick_observer, symbol_tick, int>
+            notifier(symbols, [](const symbol_tick& t) { return t.symbol; });
+    double coalesced_ns = benchmark::ns_per_op(iterations, [&]() {
+      for (std::size_t i = 0; i<batch; ++i)
+          notifier.notify(symbol_tick{int(i%16), 1});
+      notifier.flush();
+    });
+    const double n = double(batch);
+    benchmark::report("notify per tick", batch, single_ns/n);
+    benchmark::report("notify_batch (handle loop)", batch, default_ns/n);
+    benchmark::report("notify_batch (handle_batch)", batch, batch_ns/n);
+    benchmark::report("coalescing notifier (16 keys)", batch,
+            coalesced_ns/n);
+}
+
+int main()
+{
+    for (std::size_t count : {100, 1000, 10000})
+        bench_observable(count, 1000000/count*10);
+    for (std::size_t threads : {1, 4}) {
+        bench_churn<locked_observable<atomic_tick_observer>>("mutex",
+                threads, 200000/threads);
+        bench_churn<dpb::concurrent_observable<atomic_tick_observer>>(
+                "snapshot", threads, 200000/threads);
+        // the snapshot read dominates with a single observer
+        bench_churn<locked_observable<atomic_tick_observer>>(
+                "mutex, 1 observer", threads, 4000000/threads, 1);
+        bench_churn<dpb::concurrent_observable<atomic_tick_observer>>(
+                "snapshot, 1 observer", threads, 4000000/threads, 1);
+    }
+    for (std::size_t batch : {1, 64, 1024})
+        bench_batch(batch, 2000000/batch);
+    for (std::size_t per_type : {5, 50, 500})
+        bench_topics(per_type, 500000/per_type);
+    for (std::size_t count : {1000, 10000, 100000}) {
+        bench_parallel<tick_observer>("cheap", count, 10000000/count);
+        bench_parallel<busy_tick_observer>("expensive", count, 100000/count);
+    }
+    for (std::size_t producers : {1, 4, 16}) {
+        bench_async(producers, 1000000/producers, dpb::backpressure::block,
+                "block");
+        bench_async(producers, 1000000/producers,
+                dpb::backpressure::drop_newest, "drop_newest");
+    }
+    return 0;
+}
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "behavioral/visitor.hpp"
+
+namespace dpb = design_patterns::behavioral;
+
+
+class circle;
+class square;
+class triangle;
+class hexagon;
+
+typedef dpb::visitable_base<circle, square, triangle, hexagon> shape;
+typedef dpb::visitor<circle, square, triangle, hexagon> shape_visitor;
+
+class circle
+        : public dpb::visitable<circle, circle, square, triangle, hexagon> {
+public:
+    explicit circle(double r): r(r) { }
+    double r;
+};
+
+class square
+        : public dpb::visitable<square, circle, square, triangle, hexagon> {
+public:
+    explicit square(double side): side(side) { }
+    double side;
+};
+
+class triangle
+        : public dpb::visitable<triangle, circle, square, triangle, hexagon> {
+public:
+    explicit triangle(double base): base(base) { }
+    double base;
+};
+
+class hexagon
+        : public dpb::visitable<hexagon, circle, square, triangle, hexagon> {
+public:
+    explicit hexagon(double side): side(side) { }
+    double side;
+};
+
+/// Sums the areas of the visited shapes
+class area_visitor : public shape_visitor {
+public:
+    double area = 0;
+    void visit(circle& c) override { area += 3.14159*c.r*c.r; }
+    void visit(square& s) override { area += s.side*s.side; }
+    void visit(triangle& t) override { area += 0.43301*t.base*t.base; }
+    void visit(hexagon& h) override { area += 2.59808*h.side*h.side; }
+};
+
+class final_area_visitor final : public area_visitor {};
+
+/**
+ * Shapes of the 4 types in random order, each type stored contiguously
+ */
+struct shapes {
+    std::deque<circle> circles;
+    std::deque<square> squares;
+    std::deque<triangle> triangles;
+    std::deque<hexagon> hexagons;
+    std::vector<shape*> all;
+
+    explicit shapes(std::size_t size)
+    {
+        std::mt19937 rng(12345);
+        all.reserve(size);
+        for (std::size_t i = 0; i<size; ++i) {
+            const double value = double(i%100);
+            switch (rng()%4) {
+            case 0: all.push_back(&circles.emplace_back(value)); break;
+            case 1: all.push_back(&squares.emplace_back(value)); break;
+            case 2: all.push_back(&triangles.emplace_back(value)); break;
+            default: all.push_back(&hexagons.emplace_back(value)); break;
+            }
+        }
+    }
+};
+
+/**
+ * Visit shapes by accept and visit virtual calls, and by type index with
+ * a visitor subclass, a final visitor subclass and a callable. Reported
+ * per element.
+ */
+void bench_dispatch(const shapes& input, std::size_t iterations)
+{
+    const double n = double(input.all.size());
+    area_visitor virtual_visitor;
+    double accept_ns = benchmark::ns_per_op(iterations, [&]() {
+      for (auto obj : input.all)
+          obj->accept(virtual_visitor);
+    });
+    area_visitor index_visitor;
+    double index_ns = benchmark::ns_per_op(iterations, [&]() {
+      for (auto obj : input.all)
+          dpb::visit(index_visitor, *obj);
+    });
+    final_area_visitor final_visitor;
+    double final_ns = benchmark::ns_per_op(iterations, [&]() {
+      for (auto obj : input.all)
+          dpb::visit(final_visitor, *obj);
+    });
+    struct area_callable {
+        double& area;
+        void operator()(circle& c) { area += 3.14159*c.r*c.r; }
+        void operator()(square& s) { area += s.side*s.side; }
+        void operator()(triangle& t) { area += 0.43301*t.base*t.base; }
+        void operator()(hexagon& h) { area += 2.59808*h.side*h.side; }
+    };
+    double area = 0;
+    double callable_ns = benchmark::ns_per_op(iterations, [&]() {
+      for (auto obj : input.all)
+          dpb::visit(area_callable{area}, *obj);
+    });
+    benchmark::do_not_optimize(virtual_visitor.area+index_visitor.area+
+            final_visitor.area+area);
+    const std::size_t size = input.all.size();
+    benchmark::report("visit (accept)", size, accept_ns/n);
+    benchmark::report("visit (type index)", size, index_ns/n);
+    benchmark::report("visit (type index, final)", size, final_ns/n);
+    benchmark::report("visit (type index, callable)", size, callable_ns/n);
+}
+
+/**
+ * Visit shuffled or type sorted shapes one by one, and in per type
+ * batches, bucketing included or prepared once. Reported per element.
+ */
+void bench_batched(const char* order, const shapes& input,
+                   std::size_t iterations)
+{
+    const double n = double(input.all.size());
+    area_visitor accept_visitor;
+    double accept_ns = benchmark::ns_per_op(iterations, [&]() {
+      for (auto obj : input.all)
+          obj->accept(accept_visitor);
+    });
+    area_visitor batched_visitor;
+    double batched_ns = benchmark::ns_per_op(iterations, [&]() {
+      dpb::visit_batched(batched_visitor, input.all.begin(), input.all.end());
+    });
+    dpb::visit_batch<circle, square, triangle, hexagon> batch(
+            input.all.begin(), input.all.end());
+    area_visitor assign_visitor;
+    double assign_ns = benchmark::ns_per_op(iterations, [&]() {
+      batch.assign(input.all.begin(), input.all.end());
+      batch.visit(assign_visitor);
+    });
+    area_visitor batch_visitor;
+    double batch_ns = benchmark::ns_per_op(iterations, [&]() {
+      batch.visit(batch_visitor);
+    });
+    benchmark::do_not_optimize(accept_visitor.area+batched_visitor.area+
+            assign_visitor.area+batch_visitor.area);
+    const std::size_t size = input.all.size();
+    const std::string name = std::string(" (")+order+")";
+    benchmark::report("visit accept"+name, size, accept_ns/n);
+    benchmark::report("visit_batched"+name, size, batched_ns/n);
+    benchmark::report("visit_batch assign+visit"+name, size, assign_ns/n);
+    benchmark::report("visit_batch visit"+name, size, batch_ns/n);
+}
+/**
+ * Visit shapes in parallel with one visitor per worker, from 1 worker to
+ * all cores. Reported per element.
+ */
+void bench_parallel(const shapes& input, std::size_t iterations)
+{
+    const std::size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::size_t> workers;
+    for (std::size_t n = 1; n<cores; n *= 2)
+        workers.push_back(n);
+    workers.push_back(cores);
+    const double n = double(input.all.size());
+    for (std::size_t count : workers) {
+        design_patterns::work_stealing_pool pool(count);
+        double area = 0;
+        double ns = benchmark::ns_per_op(iterations, [&]() {
+          area += dpb::visit_parallel(pool, input.all.begin(),
+                  input.all.end(), []() { return final_area_visitor(); },
+                  0.0, [](double total, final_area_visitor& visitor) {
+                    return total+visitor.area;
+                  });
+        });
+        benchmark::do_not_optimize(area);
+        benchmark::report("visit_parallel (workers)", count, ns/n);
+    }
+}
+
+int main()
+{
+    // in cache, and in memory
+    bench_dispatch(shapes(10000), 1000);
+    bench_dispatch(shapes(10000000), 5);
+    shapes input(1000000);
+    bench_batched("shuffled", input, 20);
+    std::stable_sort(input.all.begin(), input.all.end(),
+            [](const shape* a, const shape* b) {
+              return a->type_index()<b->type_index();
+            });
+    bench_batched("sorted", input, 20);
+    bench_parallel(shapes(4000000), 10);
+    return 0;
+}
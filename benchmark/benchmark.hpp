@@ -0,0 +1,107 @@
+#ifndef PATTERNS_BENCHMARK_HPP
+#define PATTERNS_BENCHMARK_HPP
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace benchmark {
+
+/**
+ * Keep the compiler from optimizing away a computed value
+ * @tparam T
+ * @param value
+ */
+template<typename T>
+inline void do_not_optimize(T const& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * Run fn a number of times and measure the mean time of one run
+ * @tparam F
+ * @param iterations    Number of runs
+ * @param fn            Callable to measure
+ * @return              Nanoseconds per run
+ */
+template<typename F>
+double ns_per_op(std::size_t iterations, F&& fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i<iterations; ++i)
+        fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end-start).count()/
+            iterations;
+}
+
+/**
+ * Run fn concurrently from a number of threads and measure the throughput
+ * @tparam F
+ * @param threads       Number of threads
+ * @param iterations    Number of runs per thread
+ * @param fn            Callable to measure
+ * @return              Runs per second, for all threads
+ */
+template<typename F>
+double ops_per_sec(std::size_t threads, std::size_t iterations, F&& fn)
+{
+    std::atomic<std::size_t> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t<threads; ++t) {
+        workers.emplace_back([&]() {
+          ready++;
+          while (!go)
+              std::this_thread::yield();
+          for (std::size_t i = 0; i<iterations; ++i)
+              fn();
+        });
+    }
+    while (ready<threads)
+        std::this_thread::yield();
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (auto& worker : workers)
+        worker.join();
+    auto end = std::chrono::steady_clock::now();
+    return threads*iterations/
+            std::chrono::duration<double>(end-start).count();
+}
+
+/**
+ * Print a benchmark result row
+ * @param name      Benchmark name
+ * @param param     Benchmark parameter (size, threads, ...)
+ * @param value     Measured value
+ * @param unit      Unit of the measured value
+ */
+inline void report(const std::string& name, std::size_t param, double value,
+                   const std::string& unit = "ns/op")
+{
+    std::cout << "[ BENCH    ] " << std::left << std::setw(40) << name
+              << std::right << std::setw(10) << param
+              << std::setw(14) << std::fixed << std::setprecision(2) << value
+              << " " << unit << std::endl;
+}
+
+/**
+ * Silence std::cout while in scope, the patterns log to it on their hot paths
+ * when logging is compiled in
+ */
+class mute_cout {
+public:
+    mute_cout(): buf(std::cout.rdbuf(nullptr)) { }
+    ~mute_cout() { std::cout.rdbuf(buf); std::cout.clear(); }
+private:
+    std::streambuf* buf;
+};
+
+}
+
+#endif //PATTERNS_BENCHMARK_HPP
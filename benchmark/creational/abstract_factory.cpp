@@ -0,0 +1,169 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "creational/abstract_factory.hpp"
+
+namespace dpc = design_patterns::creational;
+
+
+// counts the allocations of every create
+static std::atomic<std::size_t> allocations{0};
+
+[[gnu::noinline]] void* operator new(std::size_t size)
+{
+    allocations++;
+    if (void* ptr = std::malloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+[[gnu::noinline]] void operator delete(void* ptr) noexcept { std::free(ptr); }
+[[gnu::noinline]] void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+
+class furniture_item : public dpc::abstract_type<furniture_item> {};
+class chair : public furniture_item {};
+class office_chair : public chair {};
+
+class chair_factory : public dpc::factory<chair> {
+public:
+    chair_factory(): factory_type("chair") {
+        register_type<office_chair>("ergonomic_office_chair");
+    }
+
+    /// Lookup of the previous base_factory::create, building the
+    /// prefixed name
+    std::unique_ptr<furniture_item> create_concatenated(const std::string& name)
+    {
+        const std::string prefixed_name = this->name+"_"+name;
+        auto found = dpc::map_holder<furniture_item>::snapshot().find(
+                prefixed_name);
+        if (!found)
+            throw dpc::factory_create_exception(name, "");
+        return found->create();
+    }
+};
+
+/**
+ * Measure time and allocations of create_fn, creating a type registered
+ * under a name of length
+ */
+template<typename F>
+void bench_create(const char* name, std::size_t length,
+                  std::size_t iterations, F&& create_fn)
+{
+    std::size_t before = allocations;
+    double ns = benchmark::ns_per_op(iterations, [&]() {
+      benchmark::do_not_optimize(create_fn());
+    });
+    double allocs = double(allocations-before)/iterations;
+    benchmark::report(name, length, ns);
+    benchmark::report(name, length, allocs, "allocs/op");
+}
+
+class catalog_item : public dpc::abstract_type<catalog_item> {};
+
+template<std::size_t Family>
+class family_item : public catalog_item {};
+
+template<std::size_t Family, std::size_t Product>
+class product_item final : public family_item<Family> {};
+
+constexpr std::size_t families = 8;
+constexpr std::size_t products = 32;
+
+template<std::size_t Family>
+class family_factory : public dpc::factory<family_item<Family>> {
+public:
+    family_factory()
+            :dpc::factory<family_item<Family>>(
+            "family_"+std::to_string(Family))
+    {
+        register_products(std::make_index_sequence<products>());
+    }
+
+private:
+    template<std::size_t... Product>
+    void register_products(std::index_sequence<Product...>)
+    {
+        (this->template register_type<product_item<Family, Product>>(
+                "product_"+std::to_string(Product)), ...);
+    }
+};
+
+class catalog : public dpc::abstract_factory<catalog_item> {
+public:
+    catalog() { register_families(std::make_index_sequence<families>()); }
+
+private:
+    template<std::size_t... Family>
+    void register_families(std::index_sequence<Family...>)
+    {
+        (register_factory<family_factory<Family>>(
+                "family_"+std::to_string(Family)), ...);
+    }
+};
+
+/**
+ * Create products of pseudo random (family, product) pairs, by names, by
+ * resolved handles and by indexes of the dispatch table
+ */
+void bench_dispatch(std::size_t iterations)
+{
+    catalog cat;
+    auto table = cat.dispatch();
+    std::vector<std::pair<std::string, std::string>> names;
+    std::vector<decltype(table)::handle> handles;
+    std::vector<std::pair<std::size_t, std::size_t>> indexes;
+    std::uint32_t seed = 12345;
+    for (std::size_t i = 0; i<1024; ++i) {
+        seed = seed*1664525u+1013904223u;
+        names.emplace_back("family_"+std::to_string((seed>>8)%families),
+                "product_"+std::to_string((seed>>16)%products));
+        handles.push_back(table.resolve(names.back().first,
+                names.back().second));
+        indexes.emplace_back(table.family(names.back().first),
+                table.product(names.back().second));
+    }
+
+    std::size_t n = 0;
+    bench_create("abstract_factory create (names)", families*products,
+            iterations, [&]() {
+      auto& pair = names[n++%names.size()];
+      return cat.create(pair.first, pair.second);
+    });
+    n = 0;
+    bench_create("abstract_factory create (handle)", families*products,
+            iterations, [&]() {
+      return table.create(handles[n++%handles.size()]);
+    });
+    n = 0;
+    bench_create("abstract_factory create (indexes)", families*products,
+            iterations, [&]() {
+      auto& pair = indexes[n++%indexes.size()];
+      return table.create(pair.first, pair.second);
+    });
+}
+
+int main()
+{
+    chair_factory cf;
+    const std::string name = "ergonomic_office_chair";
+    bench_create("factory create (concatenated)", name.size(), 1000000,
+            [&]() {
+      return cf.create_concatenated(name);
+    });
+    bench_create("factory create (prefixed)", name.size(), 1000000, [&]() {
+      return cf.create(name);
+    });
+    bench_dispatch(1000000);
+    return 0;
+}
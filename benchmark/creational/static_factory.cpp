@@ -0,0 +1,420 @@
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "creational/constexpr_factory.hpp"
+#include "creational/poly_vector.hpp"
+#include "creational/static_factory.hpp"
+
+namespace dpc = design_patterns::creational;
+
+
+struct message {
+    virtual ~message() = default;
+};
+
+struct text_message : public message {
+    explicit text_message(int id): id(id) { }
+    int id;
+};
+
+/**
+ * Lookup of the previous static_factory::create: a std::map keyed by
+ * std::string, misses reported by std::out_of_range
+ */
+struct map_factory {
+    std::map<std::string, dpc::factory_method<message, int>> functions;
+    std::mutex mtx;
+
+    std::unique_ptr<message> create(const std::string& name, int id)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        try {
+            auto el = functions.at(name);
+            return el(std::move(id));
+        }
+        catch (std::exception& ex) {
+            throw dpc::factory_create_exception(name, "int");
+        }
+    }
+};
+
+/**
+ * Parsed messages, names are views into the message buffer
+ */
+std::vector<std::string_view> parse_names(const std::string& buffer)
+{
+    std::vector<std::string_view> names;
+    std::size_t begin = 0;
+    while (begin<buffer.size()) {
+        std::size_t end = buffer.find(' ', begin);
+        names.emplace_back(buffer.data()+begin, end-begin);
+        begin = end+1;
+    }
+    return names;
+}
+
+/**
+ * Create objects by name from a registry of Types names, with a ratio of
+ * unknown names
+ */
+void bench_create(std::size_t types, std::size_t iterations)
+{
+    auto& fac = dpc::static_factory<message>::get_instance(true);
+    map_factory old;
+    std::string buffer, misses;
+    for (std::size_t i = 0; i<types; ++i) {
+        const std::string name = "message_type_"+std::to_string(i);
+        fac.register_type<text_message, int>(name);
+        old.functions[name] = &dpc::create_unique<message, text_message, int>;
+        buffer += name+" ";
+        misses += "unknown_type_"+std::to_string(i)+" ";
+    }
+    const auto names = parse_names(buffer);
+    const auto unknown = parse_names(misses);
+
+    std::size_t n = 0;
+    double map_ns = benchmark::ns_per_op(iterations, [&]() {
+      benchmark::do_not_optimize(
+              old.create(std::string(names[n++%names.size()]), 1));
+    });
+    n = 0;
+    double create_ns = benchmark::ns_per_op(iterations, [&]() {
+      benchmark::do_not_optimize(fac.create(names[n++%names.size()], 1));
+    });
+    n = 0;
+    double map_miss_ns = benchmark::ns_per_op(iterations, [&]() {
+      try {
+          old.create(std::string(unknown[n++%unknown.size()]), 1);
+      }
+      catch (dpc::factory_create_exception& ex) {
+          benchmark::do_not_optimize(ex);
+      }
+    });
+    n = 0;
+    double try_miss_ns = benchmark::ns_per_op(iterations, [&]() {
+      benchmark::do_not_optimize(
+              fac.try_create(unknown[n++%unknown.size()], 1));
+    });
+    benchmark::report("static_factory create (std::map)", types, map_ns);
+    benchmark::report("static_factory create (hash)", types, create_ns);
+    benchmark::report("static_factory miss (exception)", types, map_miss_ns);
+    benchmark::report("static_factory miss (try_create)", types, try_miss_ns);
+}
+
+
+/**
+ * Lookup of the previous static_factory::create with the current table,
+ * every creation locks the mutex of the map holder
+ */
+struct locked_factory {
+    design_patterns::name_table<dpc::factory_method<message, int>> functions;
+    std::mutex mtx;
+
+    std::unique_ptr<message> try_create(std::string_view name, int id)
+    {
+        dpc::factory_method<message, int> method;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto found = functions.find(name);
+            if (!found)
+                return nullptr;
+            method = *found;
+        }
+        return method(std::move(id));
+    }
+};
+
+/**
+ * Create objects by name concurrently from a number of threads
+ */
+void bench_contention(std::size_t threads, std::size_t iterations)
+{
+    auto& fac = dpc::static_factory<message>::get_instance(true);
+    locked_factory locked;
+    std::string buffer;
+    for (std::size_t i = 0; i<64; ++i) {
+        const std::string name = "message_type_"+std::to_string(i);
+        fac.register_type<text_message, int>(name);
+        locked.functions[name] =
+                &dpc::create_unique<message, text_message, int>;
+        buffer += name+" ";
+    }
+    const auto names = parse_names(buffer);
+
+    std::atomic<std::size_t> n{0};
+    double locked_ops = benchmark::ops_per_sec(threads, iterations, [&]() {
+      thread_local std::size_t i = n++;
+      benchmark::do_not_optimize(
+              locked.try_create(names[i++%names.size()], 1));
+    });
+    double snapshot_ops = benchmark::ops_per_sec(threads, iterations, [&]() {
+      thread_local std::size_t i = n++;
+      benchmark::do_not_optimize(fac.try_create(names[i++%names.size()], 1));
+    });
+    benchmark::report("static_factory threads (mutex)", threads,
+            locked_ops, "ops/s");
+    benchmark::report("static_factory threads (snapshot)", threads,
+            snapshot_ops, "ops/s");
+}
+
+
+template<std::size_t I>
+struct numbered_message : public message {
+    explicit numbered_message(int id): id(id) { }
+    int id;
+};
+
+/**
+ * Name of the I-th message type, message_type_I with I on three digits
+ */
+template<std::size_t I>
+struct message_name {
+    static constexpr char value[] = {'m', 'e', 's', 's', 'a', 'g', 'e', '_',
+            't', 'y', 'p', 'e', '_', char('0'+I/100), char('0'+I/10%10),
+            char('0'+I%10), '\0'};
+};
+
+template<class Sequence>
+struct message_factory;
+
+template<std::size_t... I>
+struct message_factory<std::index_sequence<I...>> {
+    typedef dpc::constexpr_factory<message,
+            dpc::factory_entry<numbered_message<I>,
+                               message_name<I>::value>...> type;
+};
+
+/**
+ * Create objects by name from Types types registered at runtime or at
+ * compile time
+ */
+template<std::size_t Types>
+void bench_constexpr(std::size_t iterations)
+{
+    typedef typename message_factory<
+            std::make_index_sequence<Types>>::type constexpr_factory;
+    auto& fac = dpc::static_factory<message>::get_instance(true);
+    std::string buffer;
+    for (std::size_t i = 0; i<Types; ++i) {
+        std::string name = "message_type_000";
+        name[13] = char('0'+i/100);
+        name[14] = char('0'+i/10%10);
+        name[15] = char('0'+i%10);
+        fac.register_type<text_message, int>(name);
+        buffer += name+" ";
+    }
+    const auto names = parse_names(buffer);
+
+    std::size_t n = 0;
+    double runtime_ns = benchmark::ns_per_op(iterations, [&]() {
+      benchmark::do_not_optimize(fac.create(names[n++%names.size()], 1));
+    });
+    n = 0;
+    double constexpr_ns = benchmark::ns_per_op(iterations, [&]() {
+      benchmark::do_not_optimize(
+              constexpr_factory::create(names[n++%names.size()], 1));
+    });
+    benchmark::report("static_factory create (runtime)", Types, runtime_ns);
+    benchmark::report("static_factory create (constexpr)", Types,
+            constexpr_ns);
+}
+
+
+/**
+ * Create objects by name and by interned name from a registry of Types
+ * names
+ */
+void bench_key(std::size_t types, std::size_t iterations)
+{
+    auto& fac = dpc::static_factory<message>::get_instance(true);
+    std::string buffer;
+    for (std::size_t i = 0; i<types; ++i) {
+        const std::string name = "message_type_"+std::to_string(i);
+        fac.register_type<text_message, int>(name);
+        buffer += name+" ";
+    }
+    const auto names = parse_names(buffer);
+    std::vector<dpc::factory_key<message, int>> keys;
+    for (auto name : names)
+        keys.push_back(fac.key<int>(name));
+
+    std::size_t n = 0;
+    double name_ns = benchmark::ns_per_op(iterations, [&]() {
+      benchmark::do_not_optimize(fac.create(names[n++%names.size()], 1));
+    });
+    n = 0;
+    double key_ns = benchmark::ns_per_op(iterations, [&]() {
+      benchmark::do_not_optimize(fac.create(keys[n++%keys.size()], 1));
+    });
+    benchmark::report("static_factory create (name)", types, name_ns);
+    benchmark::report("static_factory create (key)", types, key_ns);
+}
+
+template<std::size_t Size>
+struct sized_message : public message {
+    explicit sized_message(int id) { payload[0] = static_cast<char>(id); }
+    char payload[Size];
+};
+
+/**
+ * Create and destroy objects of mixed sizes, keeping a window of live
+ * objects, with the global allocator or pooled storage
+ */
+void bench_pooled(std::size_t iterations)
+{
+    auto& fac = dpc::static_factory<message>::get_instance(true);
+    fac.register_type<sized_message<16>, int>("small");
+    fac.register_type<sized_message<64>, int>("medium");
+    fac.register_type<sized_message<256>, int>("large");
+    fac.register_pooled<sized_message<16>, int>("pooled_small", 64);
+    fac.register_pooled<sized_message<64>, int>("pooled_medium", 64);
+    fac.register_pooled<sized_message<256>, int>("pooled_large", 64);
+    const std::vector<dpc::factory_key<message, int>> heap_keys = {
+            fac.key<int>("small"), fac.key<int>("medium"),
+            fac.key<int>("large")};
+    const std::vector<dpc::factory_key<message, int>> pooled_keys = {
+            fac.key<int>("pooled_small"), fac.key<int>("pooled_medium"),
+            fac.key<int>("pooled_large")};
+
+    std::vector<std::unique_ptr<message>> live(64);
+    std::size_t n = 0;
+    double heap_ns = benchmark::ns_per_op(iterations, [&]() {
+      live[n%live.size()] = fac.create(heap_keys[n%3], 1);
+      n++;
+    });
+    for (auto& obj : live)
+        obj.reset();
+    n = 0;
+    double pooled_ns = benchmark::ns_per_op(iterations, [&]() {
+      live[n%live.size()] = fac.create(pooled_keys[n%3], 1);
+      n++;
+    });
+    for (auto& obj : live)
+        obj.reset();
+    benchmark::report("static_factory churn (make_unique)", iterations,
+            heap_ns);
+    benchmark::report("static_factory churn (pooled)", iterations, pooled_ns);
+}
+
+/**
+ * Create batches of batch objects, one create per object, one lookup per
+ * batch, and one lookup and allocation per batch. Reported per object.
+ */
+void bench_batch(std::size_t batch, std::size_t objects)
+{
+    auto& fac = dpc::static_factory<message>::get_instance(true);
+    fac.register_type<text_message, int>("text");
+    const std::size_t iterations = objects/batch;
+
+    std::vector<std::unique_ptr<message>> products(batch);
+    double loop_ns = benchmark::ns_per_op(iterations, [&]() {
+      for (auto& product : products)
+          product = fac.create("text", 1);
+      benchmark::do_not_optimize(products.data());
+    });
+    double batch_ns = benchmark::ns_per_op(iterations, [&]() {
+      fac.create_batch("text", products.begin(), products.end(), 1);
+      benchmark::do_not_optimize(products.data());
+    });
+    double contiguous_ns = benchmark::ns_per_op(iterations, [&]() {
+      auto block = fac.create_contiguous("text", batch, 1);
+      benchmark::do_not_optimize(&block[0]);
+    });
+    benchmark::report("static_factory batch (create loop)", batch,
+            loop_ns/batch);
+    benchmark::report("static_factory batch (create_batch)", batch,
+            batch_ns/batch);
+    benchmark::report("static_factory batch (create_contiguous)", batch,
+            contiguous_ns/batch);
+}
+
+struct product {
+    virtual ~product() = default;
+    virtual long weight() const = 0;
+};
+
+template<int Weight>
+struct weighted_product final : public product {
+    explicit weighted_product(int id): id(id) { }
+    long weight() const override { return id*Weight; }
+    int id;
+};
+
+/**
+ * Call a virtual method on products of 4 types created in random order,
+ * owned by unique pointers or constructed in a poly_vector. Allocations
+ * of other sizes between the creations scatter the unique pointers as in
+ * a long running heap. Reported per product.
+ */
+void bench_poly(std::size_t products, std::size_t iterations)
+{
+    auto& fac = dpc::static_factory<product>::get_instance(true);
+    fac.register_type<weighted_product<1>, int>("product_1");
+    fac.register_type<weighted_product<2>, int>("product_2");
+    fac.register_type<weighted_product<3>, int>("product_3");
+    fac.register_type<weighted_product<4>, int>("product_4");
+    const std::string_view names[] = {"product_1", "product_2", "product_3",
+                                      "product_4"};
+
+    std::vector<std::unique_ptr<product>> owned;
+    std::vector<std::string> noise;
+    dpc::poly_vector<product> contiguous;
+    std::uint32_t seed = 12345;
+    for (std::size_t i = 0; i<products; ++i) {
+        seed = seed*1664525u+1013904223u;
+        const auto name = names[seed>>30];
+        owned.push_back(fac.create(name, int(i)));
+        contiguous.create(name, int(i));
+        noise.emplace_back((seed>>8)%96+16, 'x');
+    }
+
+    long sum = 0;
+    double owned_ns = benchmark::ns_per_op(iterations, [&]() {
+      for (auto& obj : owned)
+          sum += obj->weight();
+    });
+    double poly_ns = benchmark::ns_per_op(iterations, [&]() {
+      for (auto& obj : contiguous)
+          sum += obj.weight();
+    });
+    double for_each_ns = benchmark::ns_per_op(iterations, [&]() {
+      contiguous.for_each([&](product& obj) { sum += obj.weight(); });
+    });
+    double typed_ns = benchmark::ns_per_op(iterations, [&]() {
+      auto add = [&](auto& obj) { sum += obj.weight(); };
+      contiguous.for_each<weighted_product<1>>(add);
+      contiguous.for_each<weighted_product<2>>(add);
+      contiguous.for_each<weighted_product<3>>(add);
+      contiguous.for_each<weighted_product<4>>(add);
+    });
+    benchmark::do_not_optimize(sum);
+    const double n = double(products);
+    benchmark::report("iterate (vector<unique_ptr>)", products, owned_ns/n);
+    benchmark::report("iterate (poly_vector)", products, poly_ns/n);
+    benchmark::report("iterate (poly_vector for_each)", products,
+            for_each_ns/n);
+    benchmark::report("iterate (poly_vector per type)", products,
+            typed_ns/n);
+}
+
+int main()
+{
+    for (std::size_t types : {8, 64, 512})
+        bench_create(types, 1000000);
+    for (std::size_t threads = 1; threads<=64; threads *= 2)
+        bench_contention(threads, 2000000/threads);
+    bench_constexpr<8>(1000000);
+    bench_constexpr<64>(1000000);
+    for (std::size_t types : {8, 512})
+        bench_key(types, 1000000);
+    bench_pooled(10000000);
+    for (std::size_t batch : {1, 16, 256, 4096})
+        bench_batch(batch, 4000000);
+    bench_poly(1000000, 20);
+    return 0;
+}
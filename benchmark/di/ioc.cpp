@@ -0,0 +1,243 @@
+#include <utility>
+
+#include "benchmark.hpp"
+#include "di/ioc.hpp"
+
+namespace di = design_patterns::di;
+
+
+// ###############################
+// SERVICES
+// ###############################
+struct service {
+    virtual ~service() = default;
+};
+
+template<std::size_t I>
+struct node : public service {};
+
+template<std::size_t I>
+node<I>* make_node() { return new node<I>(); }
+
+template<std::size_t I>
+struct filler {};
+
+template<std::size_t I>
+filler<I>* make_filler() { return nullptr; }
+
+/// Number of services resolved on each iteration
+constexpr std::size_t resolved_nodes = 10;
+
+
+// ###############################
+// TYPE SLOTS VS STRING KEYS
+// ###############################
+
+template<std::size_t... I>
+void register_nodes(di::ioc_container& typed, di::ioc_container& named,
+                    std::index_sequence<I...>)
+{
+    (typed.register_type<node<I>>(&make_node<I>), ...);
+    (named.register_type<node<I>>(typeid(node<I>).name(), &make_node<I>), ...);
+}
+
+/**
+ * Grow both registries up to the same size with services that are never
+ * resolved. Type slots need a distinct type per registration.
+ */
+template<std::size_t... I>
+void register_fillers(di::ioc_container& typed, di::ioc_container& named,
+                      std::index_sequence<I...>)
+{
+    (typed.register_type<filler<I>>(&make_filler<I>), ...);
+    for (std::size_t i = 0; i<sizeof...(I); ++i)
+        named.register_type<filler<0>>("filler_"+std::to_string(i),
+                &make_filler<0>);
+}
+
+template<std::size_t... I>
+void resolve_typed(di::ioc_container& container, std::index_sequence<I...>)
+{
+    (delete container.resolve<node<I>*>(), ...);
+}
+
+template<std::size_t... I>
+void resolve_named(di::ioc_container& container, std::index_sequence<I...>)
+{
+    (delete container.resolve<node<I>>(typeid(node<I>).name()), ...);
+}
+
+template<std::size_t N>
+void bench_registry(std::size_t iterations)
+{
+    using resolved = std::make_index_sequence<resolved_nodes>;
+    di::ioc_container typed;
+    di::ioc_container named;
+    double typed_ns, named_ns;
+    {
+        benchmark::mute_cout mute;
+        register_nodes(typed, named, resolved{});
+        register_fillers(typed, named,
+                std::make_index_sequence<N-resolved_nodes>{});
+        typed_ns = benchmark::ns_per_op(iterations, [&]() {
+          resolve_typed(typed, resolved{});
+        });
+        named_ns = benchmark::ns_per_op(iterations, [&]() {
+          resolve_named(named, resolved{});
+        });
+    }
+    benchmark::report("ioc resolve (type slot)", N, typed_ns/resolved_nodes);
+    benchmark::report("ioc resolve (string key)", N, named_ns/resolved_nodes);
+}
+
+
+// ###############################
+// DYNAMIC VS COMPILED RESOLUTION
+// ###############################
+template<std::size_t I>
+struct link : public service {
+    explicit link(std::shared_ptr<link<I-1>> a, std::shared_ptr<link<I-1>> b)
+            : a(std::move(a)), b(std::move(b)) { }
+    std::shared_ptr<link<I-1>> a;
+    std::shared_ptr<link<I-1>> b;
+};
+
+template<>
+struct link<0> : public service {};
+
+template<std::size_t... I>
+void register_links(di::ioc_container& container, std::index_sequence<I...>)
+{
+    container.register_type<link<0>>();
+    (container.register_type<link<I+1>,
+                             link<I+1>,
+                             std::shared_ptr<link<I>>,
+                             std::shared_ptr<link<I>>>(), ...);
+}
+
+/**
+ * Resolve a binary tree of links, 2^(Depth+1)-1 objects per resolve
+ */
+template<std::size_t Depth>
+void bench_plan(std::size_t iterations)
+{
+    di::ioc_container dynamic;
+    di::ioc_container compiled;
+    double dynamic_ns, compiled_ns;
+    {
+        benchmark::mute_cout mute;
+        register_links(dynamic, std::make_index_sequence<Depth>{});
+        register_links(compiled, std::make_index_sequence<Depth>{});
+        compiled.compile();
+        dynamic_ns = benchmark::ns_per_op(iterations, [&]() {
+          benchmark::do_not_optimize(
+                  dynamic.resolve<std::shared_ptr<link<Depth>>>());
+        });
+        compiled_ns = benchmark::ns_per_op(iterations, [&]() {
+          benchmark::do_not_optimize(
+                  compiled.resolve<std::shared_ptr<link<Depth>>>());
+        });
+    }
+    benchmark::report("ioc resolve tree (dynamic)", Depth, dynamic_ns);
+    benchmark::report("ioc resolve tree (compiled)", Depth, compiled_ns);
+}
+
+
+// ###############################
+// CONCURRENT RESOLUTION
+// ###############################
+void bench_concurrency(std::size_t threads, std::size_t iterations)
+{
+    di::ioc_container container;
+    di::ioc_container singletons;
+    double locked_ops, snapshot_ops, singleton_ops;
+    {
+        benchmark::mute_cout mute;
+        register_links(container, std::make_index_sequence<2>{});
+        singletons.register_type<link<0>>(di::lifetime::singleton);
+        auto snapshot = container.freeze();
+        locked_ops = benchmark::ops_per_sec(threads, iterations, [&]() {
+          benchmark::do_not_optimize(
+                  container.resolve<std::shared_ptr<link<2>>>());
+        });
+        snapshot_ops = benchmark::ops_per_sec(threads, iterations, [&]() {
+          benchmark::do_not_optimize(
+                  snapshot.resolve<std::shared_ptr<link<2>>>());
+        });
+        singleton_ops = benchmark::ops_per_sec(threads, iterations, [&]() {
+          benchmark::do_not_optimize(
+                  singletons.resolve<std::shared_ptr<link<0>>>());
+        });
+    }
+    benchmark::report("ioc resolve threads (mutex)", threads,
+            locked_ops, "ops/s");
+    benchmark::report("ioc resolve threads (snapshot)", threads,
+            snapshot_ops, "ops/s");
+    benchmark::report("ioc resolve threads (singleton)", threads,
+            singleton_ops, "ops/s");
+}
+
+
+// ###############################
+// ARENA SCOPES
+// ###############################
+template<std::size_t I>
+struct part : public service {
+    explicit part(std::shared_ptr<part<I-1>> next): next(std::move(next)) { }
+    std::shared_ptr<part<I-1>> next;
+};
+
+template<>
+struct part<0> : public service {};
+
+template<std::size_t... I>
+void register_parts(di::ioc_container& container, std::index_sequence<I...>)
+{
+    container.register_type<part<0>>();
+    (container.register_type<part<I+1>,
+                             part<I+1>,
+                             std::shared_ptr<part<I>>>(), ...);
+}
+
+/**
+ * Resolve a request graph of Nodes objects in a new scope per request,
+ * allocating every object on the heap or carving them from the arena of
+ * the scope
+ */
+template<std::size_t Nodes>
+void bench_arena(std::size_t iterations)
+{
+    di::ioc_container container;
+    double heap_ns, arena_ns;
+    {
+        benchmark::mute_cout mute;
+        register_parts(container, std::make_index_sequence<Nodes-1>{});
+        auto snapshot = container.freeze();
+        heap_ns = benchmark::ns_per_op(iterations, [&]() {
+          di::ioc_scope scope(snapshot);
+          benchmark::do_not_optimize(
+                  scope.resolve<std::shared_ptr<part<Nodes-1>>>());
+        });
+        arena_ns = benchmark::ns_per_op(iterations, [&]() {
+          di::ioc_scope scope(snapshot, 4096);
+          benchmark::do_not_optimize(
+                  scope.resolve<std::shared_ptr<part<Nodes-1>>>());
+        });
+    }
+    benchmark::report("ioc resolve graph (malloc)", Nodes, heap_ns);
+    benchmark::report("ioc resolve graph (arena)", Nodes, arena_ns);
+}
+
+
+int main()
+{
+    bench_registry<10>(100000);
+    bench_registry<100>(100000);
+    bench_registry<1000>(100000);
+    bench_plan<2>(100000);
+    bench_plan<6>(10000);
+    for (std::size_t threads = 1; threads<=64; threads *= 2)
+        bench_concurrency(threads, 200000/threads);
+    bench_arena<20>(1000000);
+    return 0;
+}
@@ -1,10 +1,27 @@
 #ifndef PATTERNS_OBSERVER_HPP
 #define PATTERNS_OBSERVER_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
+#include "util/mpmc_queue.hpp"
+#include "util/thread_pool.hpp"
+
 namespace design_patterns {
 namespace behavioral {
 
@@ -15,15 +32,164 @@ template<typename _NotificationType>
 class observer<_NotificationType> {
 public:
     virtual void handle(_NotificationType& notification) = 0;
+
+    /**
+     * Handle a run of contiguous notifications, one by one by default.
+     * Overriding it for some notification types hides the others, bring
+     * them back with using observer<...>::handle_batch.
+     * @param notifications
+     * @param count
+     */
+    virtual void handle_batch(_NotificationType* notifications,
+                              std::size_t count)
+    {
+        for (std::size_t i = 0; i<count; ++i)
+            handle(notifications[i]);
+    }
 };
 
 template<typename _N, typename... _NotificationTypes>
 class observer<_N, _NotificationTypes...> : public observer<_NotificationTypes...>{
 public:
     using observer<_NotificationTypes...>::handle;
+    using observer<_NotificationTypes...>::handle_batch;
     virtual void handle(_N& notification) = 0;
+
+    /**
+     * Handle a run of contiguous notifications, one by one by default.
+     * Overriding it for some notification types hides the others, bring
+     * them back with using observer<...>::handle_batch.
+     * @param notifications
+     * @param count
+     */
+    virtual void handle_batch(_N* notifications, std::size_t count)
+    {
+        for (std::size_t i = 0; i<count; ++i)
+            handle(notifications[i]);
+    }
+};
+
+/// Subscription of an observer to an observable, the default is invalid
+struct subscription {
+    std::uint32_t index = 0;
+    std::uint32_t generation = 0;
+};
+
+namespace detail {
+
+/**
+ * Values stored in a dense array, iterated in order, and addressed by
+ * subscriptions: slots of a table indexing the dense array, with a
+ * generation counter invalidating the subscriptions of removed values.
+ * Inserting and erasing are O(1), the last value taking the place of an
+ * erased one.
+ * @tparam T
+ */
+template<class T>
+class slot_map {
+public:
+    /**
+     * Append a value
+     * @param value
+     * @return  The subscription of the value
+     */
+    subscription insert(T value)
+    {
+        std::uint32_t index;
+        if (free_slots.empty()) {
+            index = static_cast<std::uint32_t>(slots.size());
+            slots.push_back(slot{0, 1});
+        } else {
+            index = free_slots.back();
+            free_slots.pop_back();
+        }
+        slots[index].dense = static_cast<std::uint32_t>(values.size());
+        values.push_back(std::move(value));
+        owners.push_back(index);
+        return subscription{index, slots[index].generation};
+    }
+
+    /// Whether a subscription is valid
+    bool contains(subscription sub) const
+    {
+        return sub.index<slots.size() &&
+                slots[sub.index].generation==sub.generation;
+    }
+
+    /// Dense index of the value of a valid subscription
+    std::size_t position(subscription sub) const
+    {
+        return slots[sub.index].dense;
+    }
+
+    /// Subscription of the value at a dense index
+    subscription handle(std::size_t dense) const
+    {
+        return subscription{owners[dense], slots[owners[dense]].generation};
+    }
+
+    /// Erase the value at a dense index, moving the last one in place
+    void erase(std::size_t dense)
+    {
+        const std::uint32_t index = owners[dense];
+        if (dense!=values.size()-1) {
+            values[dense] = std::move(values.back());
+            owners[dense] = owners.back();
+            slots[owners[dense]].dense = static_cast<std::uint32_t>(dense);
+        }
+        values.pop_back();
+        owners.pop_back();
+        // generation 0 is never valid
+        if (++slots[index].generation==0)
+            slots[index].generation = 1;
+        free_slots.push_back(index);
+    }
+
+    std::size_t size() const { return values.size(); }
+    bool empty() const { return values.empty(); }
+
+    T& operator[](std::size_t dense) { return values[dense]; }
+    const T& operator[](std::size_t dense) const { return values[dense]; }
+
+    typename std::vector<T>::iterator begin() { return values.begin(); }
+    typename std::vector<T>::iterator end() { return values.end(); }
+    typename std::vector<T>::const_iterator begin() const
+    {
+        return values.begin();
+    }
+    typename std::vector<T>::const_iterator end() const
+    {
+        return values.end();
+    }
+
+private:
+    struct slot {
+        std::uint32_t dense;
+        std::uint32_t generation;
+    };
+
+    std::vector<T> values;
+    // slot of every value
+    std::vector<std::uint32_t> owners;
+    std::vector<slot> slots;
+    std::vector<std::uint32_t> free_slots;
 };
 
+}
+
+/**
+ * Observable keeping its observers in a slot map: observers are stored in
+ * a dense array notified in order, and subscriptions are slots of a table
+ * indexing it, with a generation counter invalidating removed
+ * subscriptions. Adding and removing observers are O(1), the last observer
+ * taking the place of a removed one. Observers are pinned by a shared
+ * reference while subscribed, so notifying them takes no reference and
+ * they may release their last owner from handle. An observer whose only
+ * reference left is the pin is expired: it is no longer notified and is
+ * destroyed when pruned, by the next notification finding it. An observer
+ * must not own its observable, the pin would keep both alive.
+ * @tparam _TObserver
+ */
 template <typename _TObserver>
 class observable {
 public:
@@ -34,14 +200,18 @@ public:
     /**
      * Add an observer to the list.
      * @param observer
+     * @return  The subscription of the observer, the existing one if it
+     *          was already added
      */
-    void add_observer(std::shared_ptr<_TObserver>& observer)
+    subscription add_observer(const std::shared_ptr<_TObserver>& observer)
     {
-        for (const auto& o : observers)
-            if (o.lock() == observer)
-                return;
-        observer_weak_ptr wo(observer);
-        observers.push_back(wo);
+        // pinned observers are alive, their address is not reused
+        auto found = subscribed.find(observer.get());
+        if (found!=subscribed.end())
+            return found->second;
+        const subscription sub = observers.insert(observer);
+        subscribed[observer.get()] = sub;
+        return sub;
     }
 
     /**
@@ -50,19 +220,41 @@ public:
      */
     void remove_observer(const observer_weak_ptr& observer)
     {
-        for(auto it = observers.begin(); it!=observers.end(); ++it) {
-            auto ptr = (*it).lock();
-            if (ptr == observer.lock()) {
-                observers.erase(it);
-                return;
-            }
-        }
+        auto found = subscribed.find(observer.lock().get());
+        if (found!=subscribed.end())
+            remove_observer(found->second);
+    }
+
+    /**
+     * Remove the observer of a subscription
+     * @param sub
+     * @return  Whether the subscription was valid
+     */
+    bool remove_observer(subscription sub)
+    {
+        if (!contains(sub))
+            return false;
+        erase(observers.position(sub));
+        return true;
+    }
+
+    /**
+     * Whether a subscription is valid
+     * @param sub
+     */
+    bool contains(subscription sub) const
+    {
+        return observers.contains(sub);
     }
 
     /**
      * Clear all observers from the list.
      */
-    void clear_observers() { observers.clear(); }
+    void clear_observers()
+    {
+        while (!observers.empty())
+            erase(observers.size()-1);
+    }
 
     /**
      * Returns the number of observers.
@@ -72,29 +264,1083 @@ public:
 
     /**
      * Notify all of the observers, sending them the notification.
-     * TNotification is the notification type.
+     * TNotification is the notification type. Expired observers are
+     * removed after the notification.
      * @tparam _TNotification
      * @param notification
      */
     template<typename _NotificationType>
     void notify(_NotificationType& notification)
     {
-        auto it = observers.begin();
-        while(it!=observers.end()) {
-            auto ptr = (*it).lock();
-            if(ptr) {
-                ptr->handle(notification);
-                it++;
-            } else {
-                it = observers.erase(it);
+        if (deliver(notification))
+            prune();
+    }
+
+    /**
+     * Notify all of the observers of a run of contiguous notifications,
+     * each observer receiving the whole run by handle_batch. Expired
+     * observers are removed after the notification.
+     * @tparam _NotificationType
+     * @param notifications
+     * @param count
+     */
+    template<typename _NotificationType>
+    void notify_batch(_NotificationType* notifications, std::size_t count)
+    {
+        if (count==0)
+            return;
+        bool expired = false;
+        for (std::size_t i = 0; i<observers.size(); ++i) {
+            if (released(observers[i]))
+                expired = true;
+            else
+                observers[i]->handle_batch(notifications, count);
+        }
+        if (expired)
+            prune();
+    }
+
+    /**
+     * Notify all of the observers without removing the expired ones, may
+     * run concurrently with other deliveries
+     * @tparam _NotificationType
+     * @param notification
+     * @return  Whether expired observers were found
+     */
+    template<typename _NotificationType>
+    bool deliver(_NotificationType& notification) const
+    {
+        bool expired = false;
+        for (std::size_t i = 0; i<observers.size(); ++i) {
+            if (released(observers[i]))
+                expired = true;
+            else
+                observers[i]->handle(notification);
+        }
+        return expired;
+    }
+
+    /**
+     * Notify all of the observers as deliver, passing the exceptions of the
+     * failed handlers to on_error, the other observers are all notified
+     * @tparam _NotificationType
+     * @tparam _ErrorHandler    Callable with a std::exception_ptr
+     * @param notification
+     * @param on_error
+     * @return  Whether expired observers were found
+     */
+    template<typename _NotificationType, typename _ErrorHandler>
+    bool deliver(_NotificationType& notification,
+                 _ErrorHandler&& on_error) const
+    {
+        bool expired = false;
+        for (std::size_t i = 0; i<observers.size(); ++i) {
+            if (released(observers[i])) {
+                expired = true;
+                continue;
+            }
+            try {
+                observers[i]->handle(notification);
+            }
+            catch (...) {
+                on_error(std::current_exception());
             }
         }
+        return expired;
+    }
+
+    /**
+     * Notify all of the observers from the workers of a pool, in chunks of
+     * consecutive observers, and wait for all of them. Handlers run
+     * concurrently and share the notification, observers are pinned so
+     * other threads may release them. Small observer sets are
+     * notified by the calling thread, the pool is not woken up. Expired
+     * observers are removed after the notification.
+     * @tparam _NotificationType
+     * @param pool
+     * @param notification
+     * @param grain     Observers per chunk, 0 for 4 chunks per worker and
+     *                  at least min_parallel_grain
+     * @throw parallel_exception with the exceptions of the failed handlers,
+     *        the other handlers are all notified
+     */
+    template<typename _NotificationType>
+    void notify_parallel(work_stealing_pool& pool,
+                         _NotificationType& notification,
+                         std::size_t grain = 0)
+    {
+        const std::size_t count = observers.size();
+        if (grain==0)
+            grain = std::max(min_parallel_grain, count/(pool.workers()*4));
+        std::atomic<bool> expired{false};
+        std::mutex errors_mtx;
+        std::vector<std::exception_ptr> errors;
+        auto chunk = [&](std::size_t first, std::size_t last, std::size_t) {
+          bool found = false;
+          for (std::size_t i = first; i<last; ++i) {
+              if (released(observers[i])) {
+                  found = true;
+                  continue;
+              }
+              try {
+                  observers[i]->handle(notification);
+              }
+              catch (...) {
+                  std::lock_guard<std::mutex> lock(errors_mtx);
+                  errors.push_back(std::current_exception());
+              }
+          }
+          if (found)
+              expired.store(true, std::memory_order_relaxed);
+        };
+        if (count<=grain || pool.workers()==1)
+            chunk(0, count, 0);
+        else
+            pool.parallel_for(count, grain, chunk);
+        if (expired.load(std::memory_order_relaxed))
+            prune();
+        if (!errors.empty())
+            throw parallel_exception(std::move(errors));
     }
 
+    /// Weak references to the observers, in notification order
+    std::vector<observer_weak_ptr> weak_observers() const
+    {
+        std::vector<observer_weak_ptr> references;
+        references.reserve(observers.size());
+        for (auto& observer : observers)
+            references.push_back(observer);
+        return references;
+    }
+
+    /**
+     * Remove the expired observers
+     * @return  Number of removed observers
+     */
+    std::size_t prune()
+    {
+        std::size_t removed = 0;
+        for (std::size_t i = observers.size(); i-->0;) {
+            if (released(observers[i])) {
+                erase(i);
+                removed++;
+            }
+        }
+        return removed;
+    }
+
+    /// Smallest default chunk of notify_parallel, amortizing a chunk pop
+    static constexpr std::size_t min_parallel_grain = 1024;
+
 private:
+    /// Whether the pin is the last reference to the observer
+    static bool released(const std::shared_ptr<_TObserver>& observer)
+    {
+        return observer.use_count()==1;
+    }
+
+    /// Remove the observer at a dense index, moving the last one in place
+    void erase(std::size_t dense)
+    {
+        subscribed.erase(observers[dense].get());
+        observers.erase(dense);
+    }
+
     /// The list of observers.
-    std::vector<observer_weak_ptr> observers;
+    detail::slot_map<std::shared_ptr<_TObserver>> observers;
+    std::unordered_map<const void*, subscription> subscribed;
+
+};
+
+/**
+ * Observable dispatching every notification type to its own subscribers.
+ * Observers subscribe per notification type, only need a handle method for
+ * the types they subscribe to, and may filter the notifications of a type
+ * by a predicate, e.g. on a key. Each type keeps its subscribers in a slot
+ * map, so notifying a type only walks the subscribers of that type.
+ * Subscribers are pinned as in observable, by one pin per observer shared
+ * by its subscriptions.
+ * @tparam _NotificationTypes
+ */
+template<typename... _NotificationTypes>
+class topic_observable {
+public:
+    topic_observable() = default;
+    topic_observable(const topic_observable&) = delete;
+    topic_observable& operator=(const topic_observable&) = delete;
+
+    /**
+     * Subscribe an observer to a notification type
+     * @tparam _NotificationType
+     * @tparam _TObserver   Type with handle(_NotificationType&)
+     * @param observer
+     * @param filter        Notifications of the type passed to the observer,
+     *                      all of them if empty
+     * @return  The subscription, valid for this notification type
+     */
+    template<typename _NotificationType, typename _TObserver>
+    subscription subscribe(const std::shared_ptr<_TObserver>& observer,
+            std::function<bool(const _NotificationType&)> filter = nullptr)
+    {
+        // keyed by the complete object, subscribed through any base
+        const void* key;
+        if constexpr (std::is_polymorphic_v<_TObserver>)
+            key = dynamic_cast<const void*>(observer.get());
+        else
+            key = observer.get();
+        pin& p = pins[key];
+        if (!p.observer) {
+            p.key = key;
+            p.observer = observer;
+        }
+        p.subscriptions++;
+        return topic<_NotificationType>().insert(subscriber<_NotificationType>{
+                observer.get(), &p, &call<_NotificationType, _TObserver>,
+                std::move(filter)});
+    }
+
+    /**
+     * Remove a subscription to a notification type
+     * @tparam _NotificationType
+     * @param sub
+     * @return  Whether the subscription was valid
+     */
+    template<typename _NotificationType>
+    bool unsubscribe(subscription sub)
+    {
+        auto& subscribers = topic<_NotificationType>();
+        if (!subscribers.contains(sub))
+            return false;
+        erase(subscribers, subscribers.position(sub));
+        return true;
+    }
+
+    /**
+     * Whether a subscription to a notification type is valid
+     * @tparam _NotificationType
+     * @param sub
+     */
+    template<typename _NotificationType>
+    bool contains(subscription sub) const
+    {
+        return topic<_NotificationType>().contains(sub);
+    }
+
+    /// Number of subscriptions to a notification type
+    template<typename _NotificationType>
+    std::size_t count_subscribers() const
+    {
+        return topic<_NotificationType>().size();
+    }
+
+    /// Number of subscriptions to all notification types
+    std::size_t count_subscribers() const
+    {
+        return (topic<_NotificationTypes>().size()+...+0);
+    }
+
+    /**
+     * Notify the subscribers of the notification type whose filter accepts
+     * it. Expired subscribers are removed after the notification.
+     * @tparam _NotificationType
+     * @param notification
+     */
+    template<typename _NotificationType>
+    void notify(_NotificationType& notification)
+    {
+        auto& subscribers = topic<_NotificationType>();
+        bool expired = false;
+        for (std::size_t i = 0; i<subscribers.size(); ++i) {
+            auto& s = subscribers[i];
+            if (released(*s.holder))
+                expired = true;
+            else if (!s.filter || s.filter(notification))
+                s.handle(s.observer, notification);
+        }
+        if (expired)
+            prune(subscribers);
+    }
+
+    /**
+     * Remove the expired subscribers of all notification types
+     * @return  Number of removed subscriptions
+     */
+    std::size_t prune()
+    {
+        return (prune(topic<_NotificationTypes>())+...+0);
+    }
+
+private:
+    /// Reference to an observer shared by its subscriptions
+    struct pin {
+        const void* key;
+        std::shared_ptr<void> observer;
+        std::size_t subscriptions = 0;
+    };
+
+    template<typename _NotificationType>
+    struct subscriber {
+        // the observer, converted back by handle
+        void* observer;
+        // stable, pins are nodes of an unordered_map
+        pin* holder;
+        void (*handle)(void*, _NotificationType&);
+        std::function<bool(const _NotificationType&)> filter;
+    };
+
+    /// Whether the pin is the last reference to the observer
+    static bool released(const pin& p)
+    {
+        return p.observer.use_count()==1;
+    }
+
+    /// Remove a subscriber, and the pin of its observer with the last one
+    template<typename _NotificationType>
+    void erase(detail::slot_map<subscriber<_NotificationType>>& subscribers,
+               std::size_t dense)
+    {
+        pin* holder = subscribers[dense].holder;
+        subscribers.erase(dense);
+        if (--holder->subscriptions==0)
+            pins.erase(holder->key);
+    }
+
+    template<typename _NotificationType, typename _TObserver>
+    static void call(void* observer, _NotificationType& notification)
+    {
+        static_cast<_TObserver*>(observer)->handle(notification);
+    }
+
+    template<typename _NotificationType>
+    detail::slot_map<subscriber<_NotificationType>>& topic()
+    {
+        return std::get<detail::slot_map<subscriber<_NotificationType>>>(
+                topics);
+    }
+
+    template<typename _NotificationType>
+    const detail::slot_map<subscriber<_NotificationType>>& topic() const
+    {
+        return std::get<detail::slot_map<subscriber<_NotificationType>>>(
+                topics);
+    }
+
+    template<typename _NotificationType>
+    std::size_t prune(
+            detail::slot_map<subscriber<_NotificationType>>& subscribers)
+    {
+        std::size_t removed = 0;
+        for (std::size_t i = subscribers.size(); i-->0;) {
+            if (released(*subscribers[i].holder)) {
+                erase(subscribers, i);
+                removed++;
+            }
+        }
+        return removed;
+    }
+
+    std::tuple<detail::slot_map<subscriber<_NotificationTypes>>...> topics;
+    std::unordered_map<const void*, pin> pins;
+};
+
+/**
+ * Observable safe to notify and subscribe from any thread. Notifiers
+ * iterate an immutable snapshot of the observers without taking the
+ * subscription lock, subscription changes build and publish a new snapshot
+ * under it. Every thread keeps a reference to the snapshot it last
+ * notified, refreshed by an atomic load only when the version changes, so
+ * notifiers touch no shared state but the version. A replaced snapshot is
+ * freed by the last thread refreshing away from it, or exiting. Expired
+ * observers found by notifiers are pruned in a batch by the next
+ * subscription change or prune, not in the notify loop.
+ * @tparam _TObserver
+ */
+template <typename _TObserver>
+class concurrent_observable {
+public:
+    typedef std::weak_ptr<_TObserver> observer_weak_ptr;
+
+    concurrent_observable() = default;
+    concurrent_observable(const concurrent_observable&) = delete;
+    concurrent_observable& operator=(const concurrent_observable&) = delete;
+
+    subscription add_observer(const std::shared_ptr<_TObserver>& observer)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        prune_stale();
+        auto sub = observers.add_observer(observer);
+        publish();
+        return sub;
+    }
+
+    void remove_observer(const observer_weak_ptr& observer)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        prune_stale();
+        observers.remove_observer(observer);
+        publish();
+    }
+
+    bool remove_observer(subscription sub)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        prune_stale();
+        const bool removed = observers.remove_observer(sub);
+        publish();
+        return removed;
+    }
+
+    void clear_observers()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        observers.clear_observers();
+        publish();
+    }
+
+    std::size_t count_observers() const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return observers.count_observers();
+    }
+
+    /// Number of snapshots alive, the current one and those kept by threads
+    std::size_t snapshots() const
+    {
+        return *live;
+    }
+
+    /**
+     * Notify the observers of the current snapshot, without locking
+     * @tparam _NotificationType
+     * @param notification
+     */
+    template<typename _NotificationType>
+    void notify(_NotificationType& notification)
+    {
+        cached& c = cache(id);
+        // a nested notify must not replace the snapshot iterated below it
+        std::shared_ptr<const snapshot> nested;
+        const snapshot* snap;
+        const std::size_t v = version.load(std::memory_order_acquire);
+        if (c.id==id && c.version==v)
+            snap = c.snap.get();
+        else if (c.users==0) {
+            c.snap = std::atomic_load(&current);
+            c.id = id;
+            c.version = v;
+            snap = c.snap.get();
+        }
+        else {
+            nested = std::atomic_load(&current);
+            snap = nested.get();
+        }
+        struct use {
+            cached& c;
+            ~use() { c.users--; }
+        } in_use{c};
+        c.users++;
+        bool expired = false;
+        if (snap) {
+            for (auto& reference : *snap) {
+                auto ptr = reference.lock();
+                // held by the pin of the observable and ptr only, or by
+                // ptr alone once removed
+                if (ptr.use_count()<=2)
+                    expired = true;
+                else
+                    ptr->handle(notification);
+            }
+        }
+        if (expired)
+            stale = true;
+    }
+
+    /**
+     * Remove the expired observers
+     * @return  Number of removed observers
+     */
+    std::size_t prune()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stale = false;
+        const std::size_t removed = observers.prune();
+        if (removed>0)
+            publish();
+        return removed;
+    }
+
+private:
+    typedef std::vector<observer_weak_ptr> snapshot;
+
+    /// Snapshot last notified by a thread
+    struct cached {
+        std::uint64_t id = 0;
+        std::size_t version = 0;
+        std::size_t users = 0;
+        std::shared_ptr<const snapshot> snap;
+    };
+
+    /// Cache of the calling thread for an observable, direct mapped by id
+    static cached& cache(std::uint64_t id)
+    {
+        thread_local cached entries[8];
+        return entries[id%8];
+    }
+
+    /// Identity of an observable in the caches, never reused
+    static std::uint64_t next_id()
+    {
+        static std::atomic<std::uint64_t> next{0};
+        return ++next;
+    }
+
+    /// Publish a snapshot of the observers, called with mtx held
+    void publish()
+    {
+        auto snap = std::make_unique<const snapshot>(
+                observers.weak_observers());
+        (*live)++;
+        // cached snapshots may outlive the observable, and live with them
+        std::atomic_store(&current, std::shared_ptr<const snapshot>(
+                snap.release(), [counter = live](const snapshot* replaced) {
+                  delete replaced;
+                  (*counter)--;
+                }));
+        version.fetch_add(1, std::memory_order_release);
+    }
+
+    /// Prune expired observers found by notifiers, called with mtx held
+    void prune_stale()
+    {
+        if (stale.exchange(false))
+            observers.prune();
+    }
+
+    observable<_TObserver> observers;
+    mutable std::mutex mtx;
+    const std::uint64_t id = next_id();
+    std::shared_ptr<std::atomic<std::size_t>> live =
+            std::make_shared<std::atomic<std::size_t>>(0);
+    std::shared_ptr<const snapshot> current;
+    std::atomic<std::size_t> version{0};
+    std::atomic<bool> stale{false};
+};
+
+/// What notify does when the queue of an async_observable is full
+enum class backpressure { block, drop_oldest, drop_newest };
+
+/**
+ * Observable delivering its notifications asynchronously: notify copies the
+ * notification into a bounded lock free queue, and dispatcher threads
+ * deliver it to the observers, so slow observers do not stall publishers.
+ * The copy is stored in the queue cell when it fits in task_buffer_size
+ * bytes, larger notifications are allocated by notify. With several
+ * dispatchers, notifications are delivered concurrently and out of order,
+ * and observers must be thread safe. Subscriptions can be changed from any
+ * thread, expired observers are pruned with them. Exceptions thrown by
+ * observers are passed to the error handler, the other observers are
+ * still notified.
+ * @tparam _TObserver
+ */
+template <typename _TObserver>
+class async_observable {
+public:
+    typedef std::weak_ptr<_TObserver> observer_weak_ptr;
+    /// Called on the delivering thread with the exception of an observer
+    typedef std::function<void(std::exception_ptr)> error_handler;
+
+    /// Notifications up to this size are stored in the queue cells
+    static constexpr std::size_t task_buffer_size = 48;
 
+    /**
+     * @param capacity      Queue capacity, rounded up to a power of two
+     * @param dispatchers   Number of dispatcher threads, with 0
+     *                      notifications are delivered by drain
+     * @param policy        Behaviour of notify when the queue is full
+     */
+    explicit async_observable(std::size_t capacity = 1024,
+                              std::size_t dispatchers = 1,
+                              backpressure policy = backpressure::block)
+            : queue(capacity), policy(policy)
+    {
+        for (std::size_t i = 0; i<dispatchers; ++i)
+            threads.emplace_back([this]() { dispatch(); });
+    }
+
+    async_observable(const async_observable&) = delete;
+    async_observable& operator=(const async_observable&) = delete;
+
+    /// Deliver the pending notifications and stop the dispatchers
+    ~async_observable()
+    {
+        stopping = true;
+        {
+            std::lock_guard<std::mutex> lock(wait_mtx);
+        }
+        wake.notify_all();
+        for (auto& thread : threads)
+            thread.join();
+        drain();
+    }
+
+    subscription add_observer(const std::shared_ptr<_TObserver>& observer)
+    {
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        prune_stale();
+        return observers.add_observer(observer);
+    }
+
+    void remove_observer(const observer_weak_ptr& observer)
+    {
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        prune_stale();
+        observers.remove_observer(observer);
+    }
+
+    bool remove_observer(subscription sub)
+    {
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        prune_stale();
+        return observers.remove_observer(sub);
+    }
+
+    void clear_observers()
+    {
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        observers.clear_observers();
+    }
+
+    std::size_t count_observers() const
+    {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        return observers.count_observers();
+    }
+
+    /**
+     * Set the handler of the exceptions thrown by observers, they are only
+     * counted by default. The handler must not throw.
+     * @param handler
+     */
+    void set_error_handler(error_handler handler)
+    {
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        on_error = std::move(handler);
+    }
+
+    /**
+     * Queue a copy of the notification for the observers, with
+     * backpressure::block waits while the queue is full
+     * @tparam _NotificationType
+     * @param notification
+     * @return  False if dropped by backpressure::drop_newest
+     */
+    template<typename _NotificationType>
+    bool notify(const _NotificationType& notification)
+    {
+        task t(notification);
+        // counted before it can be delivered, so flush waits for it
+        accepted++;
+        while (!queue.try_push(std::move(t))) {
+            if (policy==backpressure::drop_newest) {
+                dropped_count++;
+                finished();
+                return false;
+            }
+            if (policy==backpressure::drop_oldest) {
+                task oldest;
+                if (queue.try_pop(oldest)) {
+                    dropped_count++;
+                    finished();
+                }
+            }
+            else
+                wait_for_space();
+        }
+        // pairs with the dispatchers and flush checking the queue after
+        // sleeping++ and flushing++
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const bool draining = flushing>0 && threads.empty();
+        if (sleeping>0 || draining) {
+            std::lock_guard<std::mutex> lock(wait_mtx);
+            wake.notify_one();
+            if (draining)
+                idle.notify_all();
+        }
+        return true;
+    }
+
+    /**
+     * Wait until the notifications queued so far are delivered or dropped,
+     * delivering them on the calling thread without dispatchers
+     */
+    void flush()
+    {
+        const std::size_t target = accepted;
+        std::unique_lock<std::mutex> lock(wait_mtx);
+        flushing++;
+        while (completed<target) {
+            if (threads.empty() && !queue.empty()) {
+                lock.unlock();
+                drain();
+                lock.lock();
+            }
+            else
+                idle.wait(lock);
+        }
+        flushing--;
+    }
+
+    /**
+     * Deliver the queued notifications on the calling thread
+     * @return  Number of delivered notifications
+     */
+    std::size_t drain()
+    {
+        std::size_t delivered = 0;
+        task t;
+        while (pop(t)) {
+            deliver(t);
+            delivered++;
+        }
+        return delivered;
+    }
+
+    /// Number of notifications dropped by backpressure
+    std::size_t dropped() const
+    {
+        return dropped_count;
+    }
+
+    /// Number of exceptions thrown by observers
+    std::size_t errors() const
+    {
+        return error_count;
+    }
+
+private:
+    /**
+     * Queued notification, moved into the queue cell when it fits in the
+     * buffer and is nothrow movable, allocated otherwise
+     */
+    class task {
+    public:
+        task() = default;
+
+        template<typename _NotificationType, typename = std::enable_if_t<
+                !std::is_same_v<_NotificationType, task>>>
+        explicit task(const _NotificationType& notification)
+                : ops(&table<_NotificationType>)
+        {
+            if constexpr (stored_inline<_NotificationType>())
+                new (buffer) _NotificationType(notification);
+            else
+                new (buffer) _NotificationType*(
+                        new _NotificationType(notification));
+        }
+
+        task(task&& other) noexcept
+        {
+            take(other);
+        }
+
+        task& operator=(task&& other) noexcept
+        {
+            if (this!=&other) {
+                reset();
+                take(other);
+            }
+            return *this;
+        }
+
+        ~task()
+        {
+            reset();
+        }
+
+        /// Deliver the notification to the observers of owner
+        bool operator()(async_observable& owner)
+        {
+            return ops->deliver(buffer, owner);
+        }
+
+        void reset()
+        {
+            if (ops) {
+                ops->destroy(buffer);
+                ops = nullptr;
+            }
+        }
+
+    private:
+        struct operations {
+            bool (*deliver)(void*, async_observable&);
+            void (*relocate)(void*, void*);
+            void (*destroy)(void*);
+        };
+
+        template<typename _N>
+        static constexpr bool stored_inline()
+        {
+            return sizeof(_N)<=task_buffer_size &&
+                    alignof(_N)<=alignof(void*) &&
+                    std::is_nothrow_move_constructible_v<_N>;
+        }
+
+        template<typename _N>
+        static _N& stored(void* buffer)
+        {
+            if constexpr (stored_inline<_N>())
+                return *std::launder(static_cast<_N*>(buffer));
+            else
+                return **static_cast<_N**>(buffer);
+        }
+
+        template<typename _N>
+        static bool deliver_stored(void* buffer, async_observable& owner)
+        {
+            return owner.observers.deliver(stored<_N>(buffer),
+                    [&owner](std::exception_ptr error) {
+                      owner.report(std::move(error));
+                    });
+        }
+
+        template<typename _N>
+        static void relocate(void* from, void* to)
+        {
+            if constexpr (stored_inline<_N>()) {
+                new (to) _N(std::move(stored<_N>(from)));
+                stored<_N>(from).~_N();
+            }
+            else
+                new (to) _N*(*static_cast<_N**>(from));
+        }
+
+        template<typename _N>
+        static void destroy(void* buffer)
+        {
+            if constexpr (stored_inline<_N>())
+                stored<_N>(buffer).~_N();
+            else
+                delete *static_cast<_N**>(buffer);
+        }
+
+        template<typename _N>
+        static constexpr operations table{&deliver_stored<_N>,
+                                          &relocate<_N>, &destroy<_N>};
+
+        void take(task& other)
+        {
+            ops = other.ops;
+            if (ops) {
+                ops->relocate(other.buffer, buffer);
+                other.ops = nullptr;
+            }
+        }
+
+        const operations* ops = nullptr;
+        alignas(void*) unsigned char buffer[task_buffer_size];
+    };
+
+    bool pop(task& t)
+    {
+        if (!queue.try_pop(t))
+            return false;
+        // pairs with notify checking the queue after blocked++
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (blocked>0 && has_space()) {
+            std::lock_guard<std::mutex> lock(wait_mtx);
+            space.notify_all();
+        }
+        return true;
+    }
+
+    /**
+     * Whether blocked producers are woken up, once half of the queue is
+     * free so that they are not woken up by every pop
+     */
+    bool has_space() const
+    {
+        return queue.size()<=queue.capacity()/2;
+    }
+
+    /// Wait until the queue is half free, for backpressure::block
+    void wait_for_space()
+    {
+        std::unique_lock<std::mutex> lock(wait_mtx);
+        blocked++;
+        space.wait(lock, [&]() { return has_space(); });
+        blocked--;
+    }
+
+    void deliver(task& t)
+    {
+        // counted even if the delivery throws, so flush returns
+        struct completion {
+            async_observable& owner;
+            ~completion() { owner.finished(); }
+        } done{*this};
+        {
+            std::shared_lock<std::shared_mutex> lock(mtx);
+            if (t(*this))
+                stale = true;
+        }
+        t.reset();
+    }
+
+    /// Count a delivered or dropped notification, waking flush
+    void finished()
+    {
+        completed++;
+        if (flushing>0) {
+            std::lock_guard<std::mutex> lock(wait_mtx);
+            idle.notify_all();
+        }
+    }
+
+    /// Pass the exception of an observer to the handler, called with mtx held
+    void report(std::exception_ptr error)
+    {
+        error_count++;
+        if (on_error)
+            on_error(std::move(error));
+    }
+
+    /// Prune expired observers found by deliveries, called with mtx held
+    void prune_stale()
+    {
+        if (stale.exchange(false))
+            observers.prune();
+    }
+
+    void dispatch()
+    {
+        task t;
+        for (;;) {
+            if (pop(t)) {
+                deliver(t);
+                continue;
+            }
+            if (stopping && queue.empty())
+                return;
+            std::unique_lock<std::mutex> lock(wait_mtx);
+            sleeping++;
+            wake.wait(lock, [&]() { return stopping || !queue.empty(); });
+            sleeping--;
+        }
+    }
+
+    observable<_TObserver> observers;
+    error_handler on_error;
+    mutable std::shared_mutex mtx;
+    mpmc_queue<task> queue;
+    const backpressure policy;
+    std::vector<std::thread> threads;
+    std::atomic<bool> stale{false};
+    std::atomic<bool> stopping{false};
+    // dispatchers waiting for notifications, producers for space and
+    // flush callers for completions, all on wait_mtx
+    std::atomic<std::size_t> sleeping{0};
+    std::atomic<std::size_t> blocked{0};
+    std::atomic<std::size_t> flushing{0};
+    std::mutex wait_mtx;
+    std::condition_variable wake;
+    std::condition_variable space;
+    std::condition_variable idle;
+    std::atomic<std::size_t> accepted{0};
+    std::atomic<std::size_t> completed{0};
+    std::atomic<std::size_t> dropped_count{0};
+    std::atomic<std::size_t> error_count{0};
+};
+
+/**
+ * Publisher batching the notifications of an observable with latest value
+ * wins coalescing: a notification replaces the pending one of the same
+ * key, keeping its place, and pending notifications are delivered as one
+ * batch by notify_batch once the window has elapsed since the first of
+ * them, on the next notify, or by flush. Pending notifications are flushed
+ * on destruction.
+ * @tparam _TObserver
+ * @tparam _NotificationType
+ * @tparam _Key     Hashable key of a notification
+ */
+template <typename _TObserver, typename _NotificationType, typename _Key>
+class coalescing_notifier {
+public:
+    typedef std::function<_Key(const _NotificationType&)> key_function;
+
+    /**
+     * @param target    Observable notified with the batches
+     * @param key       Key of a notification
+     * @param window    Time the first pending notification waits for
+     *                  notifications replacing it, zero to flush only
+     *                  explicitly
+     */
+    coalescing_notifier(observable<_TObserver>& target, key_function key,
+            std::chrono::steady_clock::duration window =
+                    std::chrono::steady_clock::duration::zero())
+            :target(target), key(std::move(key)), window(window) { }
+
+    coalescing_notifier(const coalescing_notifier&) = delete;
+    coalescing_notifier& operator=(const coalescing_notifier&) = delete;
+
+    ~coalescing_notifier() { flush(); }
+
+    /**
+     * Add a notification to the batch, replacing the pending one with the
+     * same key, and flush the batch if the window has elapsed
+     * @param notification
+     */
+    void notify(const _NotificationType& notification)
+    {
+        auto found = positions.emplace(key(notification), pending.size());
+        if (found.second) {
+            if (pending.empty())
+                opened = std::chrono::steady_clock::now();
+            pending.push_back(notification);
+        } else {
+            pending[found.first->second] = notification;
+            coalesced_count++;
+        }
+        if (window!=std::chrono::steady_clock::duration::zero() &&
+                std::chrono::steady_clock::now()-opened>=window)
+            flush();
+    }
+
+    /**
+     * Deliver the pending notifications
+     * @return  Number of delivered notifications
+     */
+    std::size_t flush()
+    {
+        const std::size_t count = pending.size();
+        if (count==0)
+            return 0;
+        positions.clear();
+        // notifications published by the handlers start a new batch
+        std::vector<_NotificationType> batch;
+        batch.swap(pending);
+        target.notify_batch(batch.data(), count);
+        if (pending.empty()) {
+            batch.clear();
+            pending.swap(batch);
+        }
+        return count;
+    }
+
+    /// Number of pending notifications
+    std::size_t size() const { return pending.size(); }
+
+    /// Number of notifications replaced by a later one of the same key
+    std::size_t coalesced() const { return coalesced_count; }
+
+private:
+    observable<_TObserver>& target;
+    key_function key;
+    const std::chrono::steady_clock::duration window;
+    std::chrono::steady_clock::time_point opened;
+    std::vector<_NotificationType> pending;
+    std::unordered_map<_Key, std::size_t> positions;
+    std::size_t coalesced_count = 0;
 };
 
 /**
@@ -1,8 +1,17 @@
 #ifndef PATTERNS_VISITOR_HPP
 #define PATTERNS_VISITOR_HPP
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include "util/text.hpp"
+#include "util/thread_pool.hpp"
 
 namespace design_patterns {
 namespace behavioral {
@@ -27,15 +36,297 @@ public:
     virtual void visit(_VisitableType & visitable) = 0;
 };
 
+namespace detail {
+
+/// Index of T in Types, sizeof...(Types) if not found
+template<typename T, typename... Types>
+struct index_of : std::integral_constant<std::size_t, 0> {};
+
+template<typename T, typename _Type, typename... Types>
+struct index_of<T, _Type, Types...> : std::integral_constant<std::size_t,
+        std::is_same<T, _Type>::value ? 0 : 1+index_of<T, Types...>::value> {};
+
+/// Smallest tag holding an index of sizeof...(Types) types
+template<typename... Types>
+using tag_type = std::conditional_t<(sizeof...(Types)<255),
+        std::uint8_t, std::uint16_t>;
+
+}
+
+/**
+ * Common base of the visitables of a closed type list. Every visitable
+ * carries the index of its type in Types, so it can be dispatched without
+ * virtual calls, see visit.
+ * @tparam Types    Visitable types
+ */
+template<typename... Types>
+class visitable_base {
+public:
+    typedef visitor<Types...>& visitor_type;
+    virtual ~visitable_base() = default;
+    virtual void accept(visitor_type visitor) = 0;
+
+    /// Index of the visited type in Types
+    std::size_t type_index() const {
+        return tag;
+    }
+
+protected:
+    explicit visitable_base(std::size_t index)
+            : tag(static_cast<detail::tag_type<Types...>>(index)) {}
+
+private:
+    detail::tag_type<Types...> tag;
+};
+
 template<typename Derived, typename... Types>
-class visitable {
+class visitable : public visitable_base<Types...> {
 public:
     typedef visitor<Types...>& visitor_type;
-    virtual void accept(visitor_type visitor) {
+    visitable(): visitable_base<Types...>(
+            detail::index_of<Derived, Types...>::value) {}
+    void accept(visitor_type visitor) override {
         visitor.visit(static_cast<Derived&>(*this));
     }
 };
 
+namespace detail {
+
+template<typename Visitor, typename T>
+void visit_as(Visitor&& visitor_, T& visitable)
+{
+    if constexpr (std::is_invocable<Visitor&&, T&>::value)
+        std::forward<Visitor>(visitor_)(visitable);
+    else
+        visitor_.visit(visitable);
+}
+
+template<typename Visitor, typename... Types, std::size_t... I>
+void visit_index(Visitor&& visitor_, visitable_base<Types...>& visitable,
+                 std::index_sequence<I...>)
+{
+    const std::size_t index = visitable.type_index();
+    const bool visited = ((index==I && (visit_as(
+            std::forward<Visitor>(visitor_), static_cast<Types&>(visitable)),
+            true)) || ...);
+    // visitables of types out of Types are visited by accept
+    if constexpr (std::is_base_of<visitor<Types...>,
+            std::decay_t<Visitor>>::value) {
+        if (!visited)
+            visitable.accept(visitor_);
+    }
+}
+
+}
+
+/**
+ * Visit a visitable of a closed type list by its type index. The index
+ * selects the visited type in a switch generated at compile time, instead
+ * of the virtual accept and visit calls. Visit bodies can be inlined when
+ * the visitor is a final visitor<Types...> subclass, or a callable with an
+ * overload for every type. Overrides of accept are bypassed, except for
+ * visitables whose type is not in Types, accepting visitor<Types...>
+ * subclasses only.
+ * @param visitor   visitor<Types...> subclass or callable
+ * @param visitable
+ */
+template<typename Visitor, typename... Types>
+void visit(Visitor&& visitor, visitable_base<Types...>& visitable)
+{
+    detail::visit_index(std::forward<Visitor>(visitor), visitable,
+            std::index_sequence_for<Types...>());
+}
+
+/// Order of the visits of a batch
+enum class visit_order { by_type, original };
+
+/**
+ * Visitables of a closed type list bucketed by type once, to be visited in
+ * per type batches: the visited type is selected once per batch instead of
+ * once per visitable, keeping branches and visit code hot. Visitables of
+ * types out of Types are visited last, by accept.
+ * @tparam Types    Visitable types
+ */
+template<typename... Types>
+class visit_batch {
+public:
+    typedef visitable_base<Types...> visitable_type;
+
+    /**
+     * Bucket a range of pointers to visitables
+     * @param first
+     * @param last
+     */
+    template<class InputIt>
+    visit_batch(InputIt first, InputIt last)
+    {
+        assign(first, last);
+    }
+
+    /**
+     * Bucket a range of pointers to visitables, replacing the previous
+     * ones and reusing the storage
+     * @param first
+     * @param last
+     */
+    template<class InputIt>
+    void assign(InputIt first, InputIt last)
+    {
+        original.clear();
+        buckets.clear();
+        if constexpr (std::is_base_of<std::forward_iterator_tag, typename
+                std::iterator_traits<InputIt>::iterator_category>::value) {
+            original.reserve(std::distance(first, last));
+            buckets.reserve(original.capacity());
+        }
+        // counting sort, stable within a type
+        std::array<std::size_t, sizeof...(Types)+2> counts{};
+        for (; first!=last; ++first) {
+            visitable_type* obj = &**first;
+            const auto index = std::min(obj->type_index(), sizeof...(Types));
+            original.push_back(obj);
+            buckets.push_back(static_cast<detail::tag_type<Types...>>(index));
+            counts[index+1]++;
+        }
+        for (std::size_t i = 1; i<counts.size(); ++i)
+            counts[i] += counts[i-1];
+        offsets = counts;
+        sorted.resize(original.size());
+        for (std::size_t i = 0; i<original.size(); ++i)
+            sorted[counts[buckets[i]]++] = original[i];
+    }
+
+    std::size_t size() const { return original.size(); }
+
+    /// Number of visitables of the type at index in Types
+    std::size_t size(std::size_t index) const
+    {
+        return offsets[index+1]-offsets[index];
+    }
+
+    /**
+     * Visit every visitable
+     * @param visitor   visitor<Types...> subclass or callable, see visit
+     * @param order     By type batches, or in the order of the range
+     */
+    template<typename Visitor>
+    void visit(Visitor&& visitor_, visit_order order = visit_order::by_type)
+    {
+        if (order==visit_order::original) {
+            for (auto obj : original)
+                behavioral::visit(visitor_, *obj);
+            return;
+        }
+        visit_batches(visitor_, std::index_sequence_for<Types...>());
+        for (std::size_t i = offsets[sizeof...(Types)]; i<sorted.size(); ++i)
+            behavioral::visit(visitor_, *sorted[i]);
+    }
+
+private:
+    template<typename Visitor, std::size_t... I>
+    void visit_batches(Visitor& visitor_, std::index_sequence<I...>)
+    {
+        (visit_type<Types>(visitor_, offsets[I], offsets[I+1]), ...);
+    }
+
+    template<typename T, typename Visitor>
+    void visit_type(Visitor& visitor_, std::size_t first, std::size_t last)
+    {
+        for (std::size_t i = first; i<last; ++i)
+            detail::visit_as(visitor_, static_cast<T&>(*sorted[i]));
+    }
+
+    std::vector<visitable_type*> original;
+    std::vector<detail::tag_type<Types...>> buckets;
+    std::vector<visitable_type*> sorted;
+    std::array<std::size_t, sizeof...(Types)+2> offsets{};
+};
+
+namespace detail {
+
+template<typename... Types>
+visit_batch<Types...> batch_of(visitable_base<Types...>*);
+
+}
+
+/**
+ * Visit a range of pointers to visitables in per type batches, see
+ * visit_batch
+ * @param visitor   visitor<Types...> subclass or callable, see visit
+ * @param first
+ * @param last
+ */
+template<typename Visitor, class InputIt>
+void visit_batched(Visitor&& visitor_, InputIt first, InputIt last)
+{
+    typedef decltype(detail::batch_of(&**first)) batch_type;
+    batch_type(first, last).visit(visitor_);
+}
+
+namespace detail {
+
+template<typename T, typename = void>
+struct is_dereferenceable : std::false_type {};
+
+template<typename T>
+struct is_dereferenceable<T, std::void_t<decltype(*std::declval<T&>())>>
+        : std::true_type {};
+
+/// Visitor held by value or by pointer
+template<typename T>
+decltype(auto) held(T& holder)
+{
+    if constexpr (is_dereferenceable<T>::value)
+        return *holder;
+    else
+        return (holder);
+}
+
+/// Visitor of a worker, on its own cache line
+template<typename T>
+struct alignas(64) worker_visitor {
+    T holder;
+};
+
+}
+
+/**
+ * Visit a range of pointers to visitables in parallel. The range is split
+ * in chunks run by the workers of a work stealing pool, each worker
+ * visiting with its own visitor, so visitors need no synchronization.
+ * Worker visitors are then merged into the result in worker order.
+ * @param pool      Pool running the visits
+ * @param first     Random access iterator
+ * @param last
+ * @param make      Callable returning a visitor by value or by pointer,
+ *                  e.g. make_visitor, called once per worker by the
+ *                  calling thread
+ * @param init      Initial result
+ * @param reduce    Callable merging a visitor into the result,
+ *                  result = reduce(result, visitor)
+ * @return          The merged result
+ * @throw parallel_exception with the exceptions of the failed visits
+ */
+template<class RandomIt, class Factory, typename T, class Reduce>
+T visit_parallel(work_stealing_pool& pool, RandomIt first, RandomIt last,
+                 Factory&& make, T init, Reduce&& reduce)
+{
+    typedef detail::worker_visitor<std::decay_t<decltype(make())>> worker;
+    std::vector<worker> visitors;
+    visitors.reserve(pool.workers());
+    for (std::size_t i = 0; i<pool.workers(); ++i)
+        visitors.push_back(worker{make()});
+    pool.parallel_for(last-first, 0, [&](std::size_t begin, std::size_t end,
+                                         std::size_t index) {
+      auto& visitor_ = detail::held(visitors[index].holder);
+      for (std::size_t i = begin; i<end; ++i)
+          visit(visitor_, *first[i]);
+    });
+    for (auto& visitor_ : visitors)
+        init = reduce(std::move(init), detail::held(visitor_.holder));
+    return init;
+}
+
 /**
 template<typename Derived, typename... Types>
 class VisitableImpl : public Visitable<Types...> {
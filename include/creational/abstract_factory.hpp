@@ -1,6 +1,8 @@
 #ifndef PATTERNS_ABSTRACT_FACTORY_HPP
 #define PATTERNS_ABSTRACT_FACTORY_HPP
 
+#include <algorithm>
+
 #include "factory_base.hpp"
 
 namespace design_patterns {
@@ -32,7 +34,8 @@ class base_factory{
 public:
     const std::string name;
 
-    explicit base_factory(const std::string& name): name(name) {
+    explicit base_factory(const std::string& name)
+            : name(name), prefix(name+"_"), prefix_hash(hash_name(prefix)) {
         static_assert(std::is_polymorphic<_AbstractType>::value,
             "base_factory:: _AbstractType must be an abstract class");
         static_assert(std::is_base_of<
@@ -42,25 +45,124 @@ public:
     }
 
     virtual ~base_factory() {
-        auto deleted = clear();
-        std::cout << "Destroying Factory "
-                  << name << " "
-                  << deleted << std::endl;
+        [[maybe_unused]] auto deleted = clear();
+        PATTERNS_LOG_EVENT("factory", destroyed,
+                "Destroying Factory " << name << " " << deleted);
     };
 
+    /**
+     * Create instance by a name registered in this factory. Registrations
+     * are keyed by the prefixed name, looked up by its two parts without
+     * building it.
+     * @param name  The name of the registered class type
+     * @return      An instance of the requested class name
+     */
     template <typename... _Args>
-    std::unique_ptr<_AbstractType> create(const std::string& name,_Args&& ...args)
+    std::unique_ptr<_AbstractType> create(std::string_view name,_Args&& ...args)
     {
-        std::lock_guard<std::mutex> lock(map_holder<_AbstractType, _Args ...>::mtx);
-        try {
-            const std::string prefixed_name = this->name + "_" + name;
-            auto el = map_holder<_AbstractType, _Args ...>::functions.at(prefixed_name);
-            return std::move(el(std::forward<_Args>(args)...));
+        auto found = map_holder<_AbstractType, _Args ...>::snapshot().find(
+                prefix, name, hash_name(name, prefix_hash));
+        if (!found) {
+            auto args_str = print_args_types<_Args...>();
+            throw factory_create_exception(std::string(name), args_str);
         }
-        catch (std::exception& ex) {
+        factory_method<_AbstractType, _Args...> method = found->create;
+        return method(std::forward<_Args>(args)...);
+    }
+
+    /**
+     * Create count instances by a name registered in this factory, looking
+     * it up once
+     * @param name  The name of the registered class type
+     * @param count Number of instances
+     * @param args  Constructor arguments, copied for every instance
+     * @return      The instances
+     */
+    template <typename... _Args>
+    std::vector<std::unique_ptr<_AbstractType>> create_n(std::string_view name,
+                                                         std::size_t count,
+                                                         _Args... args)
+    {
+        std::vector<std::unique_ptr<_AbstractType>> products(count);
+        create_batch(name, products.begin(), products.end(), args...);
+        return products;
+    }
+
+    /**
+     * Create instances by a name registered in this factory into
+     * [first, last), looking it up once
+     * @param name  The name of the registered class type
+     * @param first Output iterator to std::unique_ptr<_AbstractType>
+     * @param last
+     * @param args  Constructor arguments, copied for every instance
+     */
+    template <class OutputIt, typename... _Args>
+    void create_batch(std::string_view name, OutputIt first, OutputIt last,
+                      _Args... args)
+    {
+        auto found = map_holder<_AbstractType, _Args ...>::snapshot().find(
+                prefix, name, hash_name(name, prefix_hash));
+        if (!found) {
             auto args_str = print_args_types<_Args...>();
-            throw factory_create_exception(name, args_str);
+            throw factory_create_exception(std::string(name), args_str);
+        }
+        const factory_methods<_AbstractType, _Args...> methods = *found;
+        create_products(methods, first, last, args...);
+    }
+
+    /**
+     * Factory method of a name registered in this factory
+     * @tparam _Args    Constructor signature types
+     * @param name      The name of the registered class type
+     * @return          The method, null if not found
+     */
+    template <typename... _Args>
+    factory_method<_AbstractType, _Args...> method(std::string_view name) const
+    {
+        auto found = map_holder<_AbstractType, _Args ...>::snapshot().find(
+                prefix, name, hash_name(name, prefix_hash));
+        return found ? found->create : nullptr;
+    }
+
+    /// Names registered in this factory, for any constructor signature
+    std::vector<std::string> product_names() const
+    {
+        std::lock_guard<std::mutex> lock(map_holder<_AbstractType>::mtx);
+        return names;
+    }
+
+    /**
+     * Intern a name registered in this factory
+     * @tparam _Args    Constructor signature types
+     * @param name      The name of the registered class type
+     * @return          The key of the name, invalid if not found. Keys are
+     *                  shared by all threads, and invalidated by clear.
+     */
+    template <typename... _Args>
+    factory_key<_AbstractType, _Args...> key(std::string_view name) const
+    {
+        return {map_holder<_AbstractType, _Args ...>::snapshot().key(
+                prefix, name, hash_name(name, prefix_hash))};
+    }
+
+    /**
+     * Create instance by an interned name
+     * @param key   The key of the registered class type
+     * @return      An instance of the requested class
+     */
+    template <typename... _Args>
+    std::unique_ptr<_AbstractType> create(
+            const factory_key<_AbstractType, _Args...>& key,
+            type_identity_t<_Args>... args)
+    {
+        auto found = map_holder<_AbstractType, _Args ...>::snapshot().find(key);
+        if (!found) {
+            auto args_str = print_args_types<_Args...>();
+            throw factory_create_exception("#"+std::to_string(key.index),
+                    args_str);
         }
+        factory_method<_AbstractType, _Args...> method = found->create;
+        return method(std::forward<_Args>(args)...);
     }
 
     /**
@@ -72,20 +174,35 @@ public:
     {
         std::lock_guard<std::mutex> lock(map_holder<_AbstractType>::mtx);
         int count = 0;
-        for (auto it = map_holder<_AbstractType>::clear_callbacks.begin();
-             it!=map_holder<_AbstractType>::clear_callbacks.end(); )
+        for (auto it = map_holder<_AbstractType>::clear_callbacks().begin();
+             it!=map_holder<_AbstractType>::clear_callbacks().end(); )
         {
             if(std::get<0>(*it)==name) {
                 std::get<1>(*it)();
-                it = map_holder<_AbstractType>::clear_callbacks.erase(it);
+                it = map_holder<_AbstractType>::clear_callbacks().erase(it);
                 count ++;
             }else{
                 it++;
             }
         }
+        names.clear();
         return count;
     }
 
+protected:
+    /// Prefix of the registration names, and its hash
+    const std::string prefix;
+    const std::uint64_t prefix_hash;
+
+    /// Record a registered name, called with map_holder<_AbstractType>::mtx
+    void add_name(const std::string& name)
+    {
+        if (std::find(names.begin(), names.end(), name)==names.end())
+            names.push_back(name);
+    }
+
+private:
+    std::vector<std::string> names;
 };
 
 /**
@@ -118,17 +235,20 @@ public:
     void register_type(const std::string& name)
     {
         assert_type<_ConcreteType>();
-        const std::string prefixed_name = this->name + "_" + name;
+        const std::string prefixed_name = this->prefix + name;
         std::lock_guard<std::mutex> lock(map_holder<_AbstractType>::mtx);
-        if (map_holder<_AbstractType>::functions.count(prefixed_name)>0) {
+        if (map_holder<_AbstractType>::functions().count(prefixed_name)>0) {
             registration_error(name);
         }
-        map_holder<_AbstractType>::functions[prefixed_name] =
-                &create_unique<_AbstractType, _ConcreteType>;
+        map_holder<_AbstractType>::functions()[prefixed_name] =
+                make_factory_methods<_AbstractType, _ConcreteType>();
+        map_holder<_AbstractType>::publish();
         clear_callback_tuple clt = std::make_tuple(this->name, []() {
-          map_holder<_AbstractType>::functions.clear();
+          map_holder<_AbstractType>::functions().clear();
+          map_holder<_AbstractType>::publish();
         });
-        map_holder<_AbstractType>::clear_callbacks.push_back(clt);
+        map_holder<_AbstractType>::clear_callbacks().push_back(clt);
+        this->add_name(name);
         print_registration_message<_ConcreteType>(name);
     };
 
@@ -136,25 +256,45 @@ public:
     void register_type(const std::string& name)
     {
         assert_type<_ConcreteType>();
-        const std::string prefixed_name = this->name + "_" + name;
-        if (map_holder<_AbstractType, _Arg0, _Args...>::functions.count(prefixed_name)>0) {
-            registration_error(name);
-        }
+        const std::string prefixed_name = this->prefix + name;
         {
             std::lock_guard<std::mutex> lock(map_holder<_AbstractType, _Arg0,_Args...>::mtx);
-            map_holder<_AbstractType, _Arg0, _Args...>::functions[prefixed_name] =
-                    &create_unique<_AbstractType, _ConcreteType, _Arg0, _Args...>;
+            if (map_holder<_AbstractType, _Arg0, _Args...>::functions().count(prefixed_name)>0) {
+                registration_error(name);
+            }
+            map_holder<_AbstractType, _Arg0, _Args...>::functions()[prefixed_name] =
+                    make_factory_methods<_AbstractType, _ConcreteType, _Arg0, _Args...>();
+            map_holder<_AbstractType, _Arg0, _Args...>::publish();
         }
         {
             // Register deleter
             clear_callback_tuple clt = std::make_tuple(this->name, []() {
-              map_holder<_AbstractType, _Arg0, _Args...>::functions.clear();
+              std::lock_guard<std::mutex> lock(
+                      map_holder<_AbstractType, _Arg0, _Args...>::mtx);
+              map_holder<_AbstractType, _Arg0, _Args...>::functions().clear();
+              map_holder<_AbstractType, _Arg0, _Args...>::publish();
             });
             std::lock_guard<std::mutex> lock_clear(map_holder<_AbstractType>::mtx);
-            map_holder<_AbstractType>::clear_callbacks.push_back(clt);
+            map_holder<_AbstractType>::clear_callbacks().push_back(clt);
+            this->add_name(name);
         }
         print_registration_message<_ConcreteType, _Arg0, _Args...>(name);
     }
+
+    /**
+     * Register _ConcreteType with pooled storage, see
+     * static_factory::register_pooled
+     * @tparam _ConcreteType
+     * @tparam _Args    Constructor signature types
+     * @param name      Registration name
+     * @param capacity  Number of free blocks kept by every thread
+     */
+    template<class _ConcreteType, typename... _Args>
+    void register_pooled(const std::string& name, std::size_t capacity)
+    {
+        object_pool<pooled<_ConcreteType>>::reserve(capacity);
+        register_type<pooled<_ConcreteType>, _Args...>(name);
+    }
 private:
     void registration_error(const std::string& name)
     {
@@ -167,31 +307,181 @@ private:
     }
 
     template<class _ConcreteType, typename... _Args>
-    void print_registration_message(const std::string& name)
+    void print_registration_message([[maybe_unused]] const std::string& name)
     {
-        auto args_str = print_args_types<_Args...>();
-        std::cout << "[----------] [OK]: " << this->name << ": "
-                  << FBLU(demangle(typeid(_ConcreteType).name()))
-                  << FBLU(" (" << args_str << ")")
-                  << FBLU(" < " << demangle(typeid(_BaseType).name()))
-                  << " registered under name " << FGRN(name)
-                  << std::endl;
+        PATTERNS_LOG_EVENT("factory", registered,
+                "[----------] [OK]: " << this->name << ": "
+                        << FBLU(demangle(typeid(_ConcreteType).name()))
+                        << FBLU(" (" << print_args_types<_Args...>() << ")")
+                        << FBLU(" < " << demangle(typeid(_BaseType).name()))
+                        << " registered under name " << FGRN(name));
     }
 
 };
 
 
+/**
+ * Flat dispatch table of an abstract factory for a constructor signature:
+ * the factory methods of every (family, product) pair, indexed by the
+ * family and product indexes. Names are resolved once into a handle, and a
+ * create costs two array indexes. The table is a snapshot, registrations
+ * made after it was built are not seen.
+ * @tparam _AbstractType
+ * @tparam _Args    Constructor signature types
+ */
+template <class _AbstractType, typename... _Args>
+class factory_dispatch {
+public:
+    /// Resolved (family, product) pair
+    struct handle {
+        std::uint32_t family = 0;
+        std::uint32_t product = 0;
+    };
+
+    static constexpr std::size_t npos = std::size_t(-1);
+
+    /// Number of families
+    std::size_t families() const { return family_index.size(); }
+
+    /// Number of products, over all families
+    std::size_t products() const { return product_index.size(); }
+
+    /// Index of a family, npos if not found
+    std::size_t family(std::string_view name) const
+    {
+        auto found = family_index.find(name);
+        return found ? *found : npos;
+    }
+
+    /// Index of a product, npos if not found
+    std::size_t product(std::string_view name) const
+    {
+        auto found = product_index.find(name);
+        return found ? *found : npos;
+    }
+
+    /**
+     * Resolve a (family, product) pair of names
+     * @return  The handle of the pair
+     * @throw factory_create_exception if the family does not register the
+     *        product
+     */
+    handle resolve(std::string_view family_name,
+                   std::string_view product_name) const
+    {
+        return resolve(family(family_name), product(product_name),
+                std::string(family_name)+"::"+std::string(product_name));
+    }
+
+    /**
+     * Resolve a (family, product) pair of indexes
+     * @return  The handle of the pair
+     * @throw factory_create_exception if the family does not register the
+     *        product
+     */
+    handle resolve(std::size_t family, std::size_t product) const
+    {
+        return resolve(family, product, "#"+std::to_string(product));
+    }
+
+    /**
+     * Create instance of a resolved pair, not checked
+     * @param h     Handle returned by resolve
+     * @param args  Constructor arguments
+     * @return      An instance of the product of the family
+     */
+    std::unique_ptr<_AbstractType> create(handle h,
+                                          type_identity_t<_Args>... args) const
+    {
+        return methods[h.family*products()+h.product](
+                std::forward<_Args>(args)...);
+    }
+
+    /**
+     * Create instance by family and product indexes
+     * @throw factory_create_exception if the family does not register the
+     *        product
+     */
+    std::unique_ptr<_AbstractType> create(std::size_t family,
+                                          std::size_t product,
+                                          type_identity_t<_Args>... args) const
+    {
+        return create(resolve(family, product), std::forward<_Args>(args)...);
+    }
+
+private:
+    template <typename> friend class abstract_factory;
+
+    handle resolve(std::size_t family, std::size_t product,
+                   const std::string& name) const
+    {
+        if (family>=families() || product>=products() ||
+                !methods[family*products()+product]) {
+            auto args_str = print_args_types<_Args...>();
+            throw factory_create_exception(name, args_str);
+        }
+        return handle{static_cast<std::uint32_t>(family),
+                      static_cast<std::uint32_t>(product)};
+    }
+
+    name_table<std::size_t> family_index;
+    name_table<std::size_t> product_index;
+    std::vector<factory_method<_AbstractType, _Args...>> methods;
+};
+
 template <typename _AbstractType>
 class abstract_factory {
 public:
 
+    /**
+     * Create instance by a name registered in a factory
+     * @param name          The name of the registered factory
+     * @param family_name   The name of the type registered in the factory
+     * @param args          Constructor arguments
+     * @return              An instance of the requested class name
+     * @throw factory_create_exception if not found
+     */
     template<typename ..._Args>
     std::unique_ptr<_AbstractType> create(const std::string& name,
                                           const std::string& family_name,
                                           _Args ...args)
     {
-        return std::move(factories[name]->create(
-                family_name, std::forward<_Args>(args)...));
+        auto found = factories.find(name);
+        if (found==factories.end()) {
+            auto args_str = print_args_types<_Args...>();
+            throw factory_create_exception(name+"::"+family_name, args_str);
+        }
+        return found->second->create(family_name, std::forward<_Args>(args)...);
+    }
+
+    /**
+     * Build the dispatch table of the registered factories for a
+     * constructor signature
+     * @tparam _Args    Constructor signature types
+     * @return          The table, families indexed in name order and
+     *                  products in order of first registration
+     */
+    template<typename ..._Args>
+    factory_dispatch<_AbstractType, _Args...> dispatch() const
+    {
+        factory_dispatch<_AbstractType, _Args...> table;
+        std::vector<std::string> products;
+        for (auto& [name, factory_] : factories) {
+            const std::size_t family = table.family_index.size();
+            table.family_index[name] = family;
+            for (auto& product : factory_->product_names()) {
+                if (!table.product_index.find(product)) {
+                    table.product_index[product] = products.size();
+                    products.push_back(product);
+                }
+            }
+        }
+        table.methods.reserve(factories.size()*products.size());
+        for (auto& [name, factory_] : factories)
+            for (auto& product : products)
+                table.methods.push_back(
+                        factory_->template method<_Args...>(product));
+        return table;
     }
 
     template<class _FactoryType>
@@ -199,8 +489,8 @@ public:
                           std::unique_ptr<_FactoryType> factory_)
     {
         factories[family_name] = std::move(factory_);
-        std::cout << "[----------] Registered factory: "
-                  << family_name << std::endl;
+        PATTERNS_LOG_EVENT("abstract_factory", registered,
+                "[----------] Registered factory: " << family_name);
     }
 
     /**
@@ -0,0 +1,270 @@
+#ifndef PATTERNS_CONSTEXPR_FACTORY_HPP
+#define PATTERNS_CONSTEXPR_FACTORY_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+#include "factory_base.hpp"
+
+namespace design_patterns {
+namespace creational {
+
+
+/**
+ * Type registered at compile time under a name, e.g.
+ *
+ *     static constexpr char circle_name[] = "circle";
+ *     factory_entry<circle, circle_name>
+ *
+ * @tparam TDerived
+ * @tparam Name     Registration name, a constexpr char array with linkage
+ */
+template<class TDerived, const char* Name>
+struct factory_entry {
+    typedef TDerived type;
+    static constexpr std::string_view name = Name;
+    static constexpr std::uint64_t hash = hash_name(name);
+};
+
+/**
+ * Static factory whose registrations are known at compile time. For every
+ * argument signature, the types constructible from it are sorted by the
+ * hash of their name, and a perfect hash of those hashes is searched, all
+ * at compile time. create hashes the name, reads its slot in the perfect
+ * hash table and calls the creator of the entry found through a constant
+ * table, with no registration or locking. When no perfect hash is found,
+ * as may happen for hundreds of types, create binary searches the sorted
+ * hashes instead. Exposes the create and registered API of static_factory,
+ * so it can replace it for hot factories.
+ * @tparam T        Base type
+ * @tparam Entries  Pack of factory_entry
+ */
+template<class T, class... Entries>
+class constexpr_factory final {
+public:
+    constexpr_factory(const constexpr_factory&) = default;
+    void operator=(constexpr_factory const&) = delete;
+
+    static constexpr_factory& get_instance(bool = false)
+    {
+        static constexpr_factory instance;
+        return instance;
+    }
+
+    /**
+     * Get number of registered types under a name
+     * @return       Number of registered classes in factory
+     */
+    static constexpr unsigned long registered(std::string_view name)
+    {
+        return ((Entries::name==name ? 1ul : 0ul)+...+0ul);
+    }
+
+    /**
+     * Get all number of registered types in the factory
+     * @return       Number of registered types in factory
+     */
+    static constexpr unsigned long registered()
+    {
+        return sizeof...(Entries);
+    }
+
+    static const std::string name()
+    {
+        return demangle(typeid(constexpr_factory<T, Entries...>).name());
+    }
+
+    /**
+     * Create instance by a registered name
+     * @param name  The name of the registered class type
+     * @return      An instance of the requested class name
+     * @throw factory_create_exception if not found
+     */
+    template<typename ...Args>
+    static std::unique_ptr<T> create(std::string_view name, Args...args)
+    {
+        auto obj = try_create(name, std::forward<Args>(args)...);
+        if (!obj) {
+            auto args_str = print_args_types<Args...>();
+            throw factory_create_exception(std::string(name), args_str);
+        }
+        return obj;
+    }
+
+    /**
+     * Create instance by a registered name, types not constructible from
+     * the arguments are skipped
+     * @param name  The name of the registered class type
+     * @return      An instance of the requested class name, or null if not
+     *              found.
+     */
+    template<typename ...Args>
+    static std::unique_ptr<T> try_create(std::string_view name, Args...args)
+    {
+        std::unique_ptr<T> obj;
+        if constexpr (constructible_count<Args...>>0) {
+            const std::uint64_t hash = hash_name(name);
+            const auto& entries = entries_by_hash<Args...>;
+            auto it = entries.end();
+            if constexpr (multiplier<Args...>!=0) {
+                const std::size_t first = hash_slots<Args...>[
+                        slot_of(hash, multiplier<Args...>, slot_bits<Args...>)];
+                if (first!=0)
+                    it = entries.begin()+(first-1);
+            }
+            else {
+                it = std::lower_bound(entries.begin(), entries.end(), hash,
+                        [](const hashed_entry& entry, std::uint64_t hash) {
+                          return entry.hash<hash;
+                        });
+            }
+            // names sharing a hash, in order of registration
+            for (; it!=entries.end() && it->hash==hash; ++it) {
+                if (creators<Args...>[it->index](name, obj, args...))
+                    break;
+            }
+        }
+        return obj;
+    }
+
+private:
+    constexpr_factory() = default;
+
+    /// Hash of the name of an entry, and its position in Entries
+    struct hashed_entry {
+        std::uint64_t hash;
+        std::size_t index;
+    };
+
+    template<typename ...Args>
+    static constexpr std::size_t constructible_count =
+            (std::size_t(std::is_constructible<typename Entries::type,
+                    Args&&...>::value)+...+0);
+
+    /// Entries constructible from Args, sorted by hash, stable
+    template<typename ...Args>
+    static constexpr std::array<hashed_entry, constructible_count<Args...>>
+    sort_entries()
+    {
+        constexpr bool constructible[] = {std::is_constructible<
+                typename Entries::type, Args&&...>::value..., false};
+        constexpr std::uint64_t hashes[] = {Entries::hash..., 0};
+        std::array<hashed_entry, constructible_count<Args...>> sorted{};
+        std::size_t size = 0;
+        for (std::size_t i = 0; i<sizeof...(Entries); ++i) {
+            if (!constructible[i])
+                continue;
+            std::size_t j = size++;
+            for (; j>0 && sorted[j-1].hash>hashes[i]; --j)
+                sorted[j] = sorted[j-1];
+            sorted[j] = hashed_entry{hashes[i], i};
+        }
+        return sorted;
+    }
+
+    template<typename ...Args>
+    static constexpr auto entries_by_hash = sort_entries<Args...>();
+
+    /// Slots of the perfect hash table, 8 to 16 per entry
+    template<typename ...Args>
+    static constexpr std::size_t slot_bits = []() {
+        std::size_t bits = 3;
+        while ((std::size_t(1)<<(bits-3))<constructible_count<Args...>)
+            ++bits;
+        return bits;
+    }();
+
+    static constexpr std::size_t slot_of(std::uint64_t hash,
+                                         std::uint64_t multiplier,
+                                         std::size_t bits)
+    {
+        return static_cast<std::size_t>((hash*multiplier)>>(64-bits));
+    }
+
+    /// Odd multiplier giving every distinct hash its own slot, or 0
+    template<typename ...Args>
+    static constexpr std::uint64_t find_multiplier()
+    {
+        const auto& entries = entries_by_hash<Args...>;
+        for (std::uint64_t seed = 0; seed<32; ++seed) {
+            const std::uint64_t multiplier = 0x9e3779b97f4a7c15ull+2*seed;
+            bool used[std::size_t(1)<<slot_bits<Args...>] = {};
+            bool perfect = true;
+            for (std::size_t i = 0; perfect && i<entries.size(); ++i) {
+                if (i>0 && entries[i].hash==entries[i-1].hash)
+                    continue;
+                const std::size_t slot = slot_of(entries[i].hash, multiplier,
+                        slot_bits<Args...>);
+                perfect = !used[slot];
+                used[slot] = true;
+            }
+            if (perfect)
+                return multiplier;
+        }
+        return 0;
+    }
+
+    template<typename ...Args>
+    static constexpr std::uint64_t multiplier = find_multiplier<Args...>();
+
+    /// Position+1 of the first entry of every hash in entries_by_hash, by slot
+    template<typename ...Args>
+    static constexpr std::array<std::uint16_t,
+                                std::size_t(1)<<slot_bits<Args...>>
+    make_hash_slots()
+    {
+        const auto& entries = entries_by_hash<Args...>;
+        std::array<std::uint16_t, std::size_t(1)<<slot_bits<Args...>> slots{};
+        for (std::size_t i = entries.size(); i>0; --i) {
+            slots[slot_of(entries[i-1].hash, multiplier<Args...>,
+                    slot_bits<Args...>)] = static_cast<std::uint16_t>(i);
+        }
+        return slots;
+    }
+
+    template<typename ...Args>
+    static constexpr auto hash_slots = make_hash_slots<Args...>();
+
+    template<class TDerived>
+    constexpr static void assert_type()
+    {
+        static_assert(std::is_base_of<T, TDerived>::value,
+                "constexpr_factory: TDerived must be derived from T");
+    }
+
+    template<class Entry, typename ...Args>
+    static bool try_entry(std::string_view name, std::unique_ptr<T>& obj,
+                          Args&...args)
+    {
+        typedef typename Entry::type derived_type;
+        assert_type<derived_type>();
+        if constexpr (std::is_constructible<derived_type, Args&&...>::value) {
+            if (name==Entry::name) {
+                obj = std::make_unique<derived_type>(std::forward<Args>(args)...);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template<typename ...Args>
+    using creator = bool (*)(std::string_view name, std::unique_ptr<T>& obj,
+                             Args&...args);
+
+    /// Creators of Entries, by position
+    template<typename ...Args>
+    static constexpr creator<Args...> creators[] = {
+            &try_entry<Entries, Args...>..., nullptr};
+
+    static_assert(sizeof...(Entries)<UINT16_MAX,
+            "constexpr_factory: too many entries");
+};
+
+
+}
+}
+
+#endif //PATTERNS_CONSTEXPR_FACTORY_HPP
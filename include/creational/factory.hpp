@@ -2,7 +2,9 @@
 #define PATTERNS_FACTORY_HPP
 
 #include "static_factory.hpp"
+#include "constexpr_factory.hpp"
 #include "abstract_factory.hpp"
+#include "poly_vector.hpp"
 
 
 #endif //PATTERNS_FACTORY_HPP
@@ -1,15 +1,27 @@
 #ifndef PATTERNS_FACTORY_BASE_HPP
 #define PATTERNS_FACTORY_BASE_HPP
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <map>
 #include <tuple>
 #include <iostream>
 #include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string_view>
 #include <typeinfo>
+#include <utility>
+#include <vector>
 #include <cxxabi.h>
 
+#include "util/log.hpp"
+#include "util/name_table.hpp"
 #include "util/text.hpp"
+#include "util/types.hpp"
 #include "util/color.hpp"
 #include "exception.hpp"
 
@@ -38,40 +50,113 @@ public:
 template<class BaseType, class... Args>
 using factory_method = std::unique_ptr<BaseType>(*)(Args&& ...);
 
+/// Factory method constructing in a given storage
+template<class BaseType, class... Args>
+using placement_method = BaseType* (*)(void* storage, Args&& ...);
+
+/**
+ * Factory methods registered for a type, and the storage it needs
+ * @tparam BaseType
+ * @tparam Args
+ */
+template<class BaseType, class... Args>
+struct factory_methods {
+    factory_method<BaseType, Args...> create = nullptr;
+    placement_method<BaseType, Args...> construct = nullptr;
+    std::size_t size = 0;
+    std::size_t align = 0;
+    const std::type_info* type = nullptr;
+};
+
 
 /// Clear Callback Tuple
 typedef std::tuple<std::string, std::function<void()>> clear_callback_tuple;
 
 /**
- * Map Holder of factory methods
+ * Interned registration name of the factory methods of BaseType with
+ * constructor arguments Args. Keys are obtained from the factories, and are
+ * invalidated when their registrations are cleared.
  * @tparam BaseType
  * @tparam Args
  */
 template<class BaseType, class... Args>
-struct map_holder {
-  static std::map<std::string, factory_method<BaseType, Args...>> functions;
-  static std::vector<clear_callback_tuple> clear_callbacks;
-  static std::mutex mtx;
-};
+struct factory_key : name_key {};
 
 /**
- * Map Holder Functions Map
+ * Map Holder of factory methods. Registrations change functions under mtx
+ * and publish an immutable copy of it with an atomic store. Creations read
+ * the published table without taking mtx: every thread keeps a reference
+ * to the table it last read, refreshed by an atomic load only when the
+ * version changes, so reads touch no shared state but the version.
+ * Replaced tables are released by the last thread refreshing away from
+ * them.
+ *
+ * Tables and callbacks are function local statics, built on first use, so
+ * registrations from static initializers of any translation unit are kept;
+ * mtx and version are constant initialized.
  * @tparam BaseType
  * @tparam Args
  */
 template<class BaseType, class... Args>
-std::map<std::string, factory_method<BaseType, Args...>>map_holder<
-        BaseType,
-        Args...>::functions;
+struct map_holder {
+  typedef name_table<factory_methods<BaseType, Args...>> table_type;
+
+  static std::mutex mtx;
+  static std::atomic<std::size_t> version;
+
+  /// Registered functions, changed with mtx held
+  static table_type& functions()
+  {
+      static table_type table;
+      return table;
+  }
+
+  /// Clear callbacks, changed with mtx held
+  static std::vector<clear_callback_tuple>& clear_callbacks()
+  {
+      static std::vector<clear_callback_tuple> callbacks;
+      return callbacks;
+  }
+
+  /// Publish a copy of functions, called with mtx held
+  static void publish()
+  {
+      std::atomic_store(&published(),
+              std::make_shared<const table_type>(functions()));
+      version.fetch_add(1, std::memory_order_release);
+  }
+
+  /// Published table, valid until the next snapshot on the calling thread
+  static const table_type& snapshot()
+  {
+      static const table_type empty;
+      thread_local std::shared_ptr<const table_type> local;
+      thread_local std::size_t local_version = 0;
+      const std::size_t current = version.load(std::memory_order_acquire);
+      if (current!=local_version) {
+          local = std::atomic_load(&published());
+          local_version = current;
+      }
+      // null until the first registration
+      return local ? *local : empty;
+  }
+
+private:
+  /// Last published copy of functions
+  static std::shared_ptr<const table_type>& published()
+  {
+      static std::shared_ptr<const table_type> table;
+      return table;
+  }
+};
 
 /**
- * Clear Map Holder callbacks vector
+ * Map Holder Published Functions Version
  * @tparam BaseType
  * @tparam Args
  */
 template<class BaseType, class... Args>
-std::vector<clear_callback_tuple> map_holder<BaseType,
-                                             Args...>::clear_callbacks;
+std::atomic<std::size_t> map_holder<BaseType, Args...>::version{0};
 
 /**
  * Map Holder Mutex
@@ -96,6 +181,222 @@ std::unique_ptr<_BaseType> create_unique(Args&& ...args)
     return std::make_unique<TDerived>(std::forward<Args>(args)...);
 }
 
+/**
+* Construct class TDerived < _BaseType in a given storage
+* @tparam _BaseType
+* @tparam TDerived
+* @tparam Args
+* @param storage
+* @param args
+* @return
+*/
+template<class _BaseType, class TDerived, typename ...Args>
+_BaseType* construct_at(void* storage, Args&& ...args)
+{
+    return ::new (storage) TDerived(std::forward<Args>(args)...);
+}
+
+/**
+ * Factory methods of class TDerived < _BaseType
+ * @tparam _BaseType
+ * @tparam TDerived
+ * @tparam Args
+ * @return
+ */
+template<class _BaseType, class TDerived, typename ...Args>
+constexpr factory_methods<_BaseType, Args...> make_factory_methods()
+{
+    return {&create_unique<_BaseType, TDerived, Args...>,
+            &construct_at<_BaseType, TDerived, Args...>,
+            sizeof(TDerived), alignof(TDerived), &typeid(TDerived)};
+}
+
+/**
+ * Products constructed contiguously in a single allocation, destroyed
+ * together in reverse order of construction
+ * @tparam T
+ */
+template<class T>
+class product_block {
+public:
+    product_block() = default;
+    product_block(product_block&& other) noexcept
+            : storage(std::exchange(other.storage, nullptr)),
+              align(other.align), products(std::move(other.products)) { }
+    product_block& operator=(product_block&& other) noexcept
+    {
+        std::swap(storage, other.storage);
+        std::swap(align, other.align);
+        std::swap(products, other.products);
+        return *this;
+    }
+
+    ~product_block()
+    {
+        for (auto it = products.rbegin(); it!=products.rend(); ++it)
+            (*it)->~T();
+        if (storage)
+            ::operator delete(storage, std::align_val_t(align));
+    }
+
+    std::size_t size() const { return products.size(); }
+    T& operator[](std::size_t i) { return *products[i]; }
+    const T& operator[](std::size_t i) const { return *products[i]; }
+
+    /**
+     * Construct count products with the given methods
+     * @tparam Args
+     * @param methods
+     * @param count
+     * @param args      Constructor arguments, copied for every product
+     * @return
+     */
+    template<typename ...Args>
+    static product_block construct(const factory_methods<T, Args...>& methods,
+                                   std::size_t count, const Args&... args)
+    {
+        static_assert(std::has_virtual_destructor<T>::value ||
+                std::is_trivially_destructible<T>::value,
+                "product_block: T must have a virtual destructor");
+        product_block block;
+        const std::size_t stride =
+                (methods.size+methods.align-1)/methods.align*methods.align;
+        block.align = methods.align;
+        block.storage = ::operator new(stride*count,
+                std::align_val_t(methods.align));
+        block.products.reserve(count);
+        auto* bytes = static_cast<unsigned char*>(block.storage);
+        for (std::size_t i = 0; i<count; ++i)
+            block.products.push_back(
+                    methods.construct(bytes+i*stride, Args(args)...));
+        return block;
+    }
+
+private:
+    void* storage = nullptr;
+    std::size_t align = alignof(std::max_align_t);
+    std::vector<T*> products;
+};
+
+/**
+ * Create products with the given methods into [first, last)
+ * @tparam T
+ * @tparam Args
+ * @tparam OutputIt
+ * @param methods
+ * @param first
+ * @param last
+ * @param args      Constructor arguments, copied for every product
+ */
+template<class T, typename ...Args, class OutputIt>
+void create_products(const factory_methods<T, Args...>& methods,
+                     OutputIt first, OutputIt last, const Args&... args)
+{
+    for (; first!=last; ++first)
+        *first = methods.create(Args(args)...);
+}
+
+/**
+ * Per thread free lists recycling the storage of T objects. Storage freed
+ * by a thread is reused by its next allocations, up to capacity blocks per
+ * thread, the rest goes back to the global allocator.
+ * @tparam T
+ */
+template<class T>
+class object_pool {
+public:
+    static_assert(alignof(T)<=__STDCPP_DEFAULT_NEW_ALIGNMENT__,
+            "object_pool: over aligned types are not supported");
+
+    /**
+     * Raise the number of blocks kept by every thread
+     * @param capacity
+     */
+    static void reserve(std::size_t capacity)
+    {
+        std::size_t current = max_blocks.load(std::memory_order_relaxed);
+        while (current<capacity &&
+                !max_blocks.compare_exchange_weak(current, capacity,
+                        std::memory_order_relaxed)) { }
+    }
+
+    static void* allocate()
+    {
+        free_list& list = local();
+        if (node* block = list.head) {
+            list.head = block->next;
+            list.size--;
+            return block;
+        }
+        return ::operator new(block_size);
+    }
+
+    static void deallocate(void* ptr)
+    {
+        free_list& list = local();
+        if (list.size<max_blocks.load(std::memory_order_relaxed)) {
+            list.head = new (ptr) node{list.head};
+            list.size++;
+            return;
+        }
+        ::operator delete(ptr);
+    }
+
+private:
+    struct node {
+        node* next;
+    };
+
+    struct free_list {
+        node* head = nullptr;
+        std::size_t size = 0;
+
+        ~free_list() {
+            while (head) {
+                node* block = head;
+                head = block->next;
+                ::operator delete(block);
+            }
+        }
+    };
+
+    static constexpr std::size_t block_size =
+            sizeof(T)>sizeof(node) ? sizeof(T) : sizeof(node);
+
+    static free_list& local()
+    {
+        thread_local free_list list;
+        return list;
+    }
+
+    static std::atomic<std::size_t> max_blocks;
+};
+
+template<class T>
+std::atomic<std::size_t> object_pool<T>::max_blocks{0};
+
+/**
+ * TDerived allocated from its object_pool. Products keep being deleted
+ * through their base type: the deleting destructor of a pooled object
+ * calls its class operator delete, which recycles the storage.
+ * @tparam TDerived
+ */
+template<class TDerived>
+class pooled final : public TDerived {
+public:
+    using TDerived::TDerived;
+
+    static void* operator new(std::size_t)
+    {
+        return object_pool<pooled>::allocate();
+    }
+
+    static void operator delete(void* ptr)
+    {
+        object_pool<pooled>::deallocate(ptr);
+    }
+};
+
 }
 }
 
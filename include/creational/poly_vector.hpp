@@ -0,0 +1,365 @@
+#ifndef PATTERNS_POLY_VECTOR_HPP
+#define PATTERNS_POLY_VECTOR_HPP
+
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include "factory_base.hpp"
+
+namespace design_patterns {
+namespace creational {
+
+
+/**
+ * Container of polymorphic products constructed in place, grouped by
+ * concrete type. Products of a type live in contiguous chunks of its
+ * segment, chunks grow geometrically and never move, so references stay
+ * valid until clear. Products are created by a name registered in the
+ * static_factory<T> registry or by type, and iterated as T, or per type
+ * without virtual dispatch.
+ * @tparam T    Base type, with a virtual destructor
+ */
+template<class T>
+class poly_vector {
+    static_assert(std::has_virtual_destructor<T>::value,
+            "poly_vector: T must have a virtual destructor");
+
+    struct chunk {
+        unsigned char* data;
+        std::size_t capacity;
+        std::size_t size;
+    };
+
+    /// Products of one concrete type
+    struct segment {
+        const std::type_info* type;
+        std::size_t stride;
+        std::size_t align;
+        // offset of the T subobject within the product
+        std::ptrdiff_t offset;
+        std::vector<chunk> chunks;
+        std::size_t size;
+
+        unsigned char* slot()
+        {
+            if (chunks.empty() || chunks.back().size==chunks.back().capacity) {
+                std::size_t capacity = chunks.empty()
+                        ? first_chunk : chunks.back().capacity*2;
+                auto* data = static_cast<unsigned char*>(::operator new(
+                        capacity*stride, std::align_val_t(align)));
+                chunks.push_back(chunk{data, capacity, 0});
+            }
+            return chunks.back().data+chunks.back().size*stride;
+        }
+
+        void constructed(unsigned char* slot, const T* obj)
+        {
+            offset = reinterpret_cast<const unsigned char*>(obj)-slot;
+            chunks.back().size++;
+            size++;
+        }
+    };
+
+    template<bool Const>
+    class basic_iterator {
+        typedef std::conditional_t<Const, const segment*, segment*>
+                segment_pointer;
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::conditional_t<Const, const T*, T*> pointer;
+        typedef std::conditional_t<Const, const T&, T&> reference;
+
+        basic_iterator() = default;
+
+        reference operator*() const { return *get(); }
+        pointer operator->() const { return get(); }
+
+        basic_iterator& operator++()
+        {
+            ++item;
+            settle();
+            return *this;
+        }
+
+        basic_iterator operator++(int)
+        {
+            basic_iterator it = *this;
+            ++*this;
+            return it;
+        }
+
+        bool operator==(const basic_iterator& other) const
+        {
+            return seg==other.seg && index==other.index && item==other.item;
+        }
+
+        bool operator!=(const basic_iterator& other) const
+        {
+            return !(*this==other);
+        }
+
+    private:
+        friend class poly_vector;
+
+        basic_iterator(segment_pointer seg, segment_pointer last)
+                :seg(seg), last(last) { settle(); }
+
+        /// Move to the next product, skipping exhausted chunks and segments
+        void settle()
+        {
+            while (seg!=last) {
+                if (index<seg->chunks.size()) {
+                    if (item<seg->chunks[index].size)
+                        return;
+                    ++index;
+                    item = 0;
+                    continue;
+                }
+                ++seg;
+                index = 0;
+            }
+        }
+
+        pointer get() const
+        {
+            return std::launder(reinterpret_cast<pointer>(
+                    seg->chunks[index].data+item*seg->stride+seg->offset));
+        }
+
+        segment_pointer seg = nullptr;
+        segment_pointer last = nullptr;
+        std::size_t index = 0;
+        std::size_t item = 0;
+    };
+
+public:
+    typedef basic_iterator<false> iterator;
+    typedef basic_iterator<true> const_iterator;
+
+    poly_vector() = default;
+    poly_vector(const poly_vector&) = delete;
+    poly_vector& operator=(const poly_vector&) = delete;
+
+    poly_vector(poly_vector&& other) noexcept
+            :segments(std::move(other.segments)),
+             products(std::exchange(other.products, 0))
+    {
+        other.segments.clear();
+    }
+
+    poly_vector& operator=(poly_vector&& other) noexcept
+    {
+        clear();
+        std::swap(segments, other.segments);
+        std::swap(products, other.products);
+        return *this;
+    }
+
+    ~poly_vector() { clear(); }
+
+    /**
+     * Construct a product of type TDerived
+     * @tparam TDerived
+     * @tparam Args
+     * @param args  Constructor arguments
+     * @return      The product
+     */
+    template<class TDerived, typename ...Args>
+    TDerived& emplace(Args&& ...args)
+    {
+        static_assert(std::is_base_of<T, TDerived>::value,
+                "poly_vector: TDerived must be derived from T");
+        segment& seg = segment_for(typeid(TDerived), sizeof(TDerived),
+                alignof(TDerived));
+        unsigned char* slot = seg.slot();
+        auto* obj = ::new (slot) TDerived(std::forward<Args>(args)...);
+        seg.constructed(slot, obj);
+        products++;
+        return *obj;
+    }
+
+    /**
+     * Construct a product by a name registered in static_factory<T>
+     * @param name  The name of the registered class type
+     * @param args  Constructor arguments
+     * @return      The product
+     * @throw factory_create_exception if not found
+     */
+    template<typename ...Args>
+    T& create(std::string_view name, Args...args)
+    {
+        const auto methods = find_methods<Args...>(name);
+        return construct(methods, segment_for(methods), std::move(args)...);
+    }
+
+    /**
+     * Construct count products by a name registered in static_factory<T>,
+     * looking it up once
+     * @param name  The name of the registered class type
+     * @param count Number of products
+     * @param args  Constructor arguments, copied for every product
+     * @throw factory_create_exception if not found
+     */
+    template<typename ...Args>
+    void create_n(std::string_view name, std::size_t count, Args...args)
+    {
+        const auto methods = find_methods<Args...>(name);
+        segment& seg = segment_for(methods);
+        for (std::size_t i = 0; i<count; ++i)
+            construct(methods, seg, Args(args)...);
+    }
+
+    /**
+     * Call fn on every product, grouped by type
+     * @param fn    Callable with T&
+     */
+    template<class Fn>
+    void for_each(Fn&& fn)
+    {
+        for (auto& seg : segments)
+            for (auto& c : seg.chunks)
+                for (std::size_t i = 0; i<c.size; ++i)
+                    fn(*std::launder(reinterpret_cast<T*>(
+                            c.data+i*seg.stride+seg.offset)));
+    }
+
+    /**
+     * Call fn on every product of type TDerived, statically typed so calls
+     * on final types are not dispatched virtually
+     * @tparam TDerived
+     * @param fn    Callable with TDerived&
+     */
+    template<class TDerived, class Fn>
+    void for_each(Fn&& fn)
+    {
+        segment* seg = find_segment(typeid(TDerived));
+        if (!seg)
+            return;
+        for (auto& c : seg->chunks)
+            for (std::size_t i = 0; i<c.size; ++i)
+                fn(*std::launder(reinterpret_cast<TDerived*>(
+                        c.data+i*seg->stride)));
+    }
+
+    iterator begin()
+    {
+        return iterator(segments.data(), segments.data()+segments.size());
+    }
+
+    iterator end()
+    {
+        segment* last = segments.data()+segments.size();
+        return iterator(last, last);
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(segments.data(),
+                segments.data()+segments.size());
+    }
+
+    const_iterator end() const
+    {
+        const segment* last = segments.data()+segments.size();
+        return const_iterator(last, last);
+    }
+
+    /// Number of products
+    std::size_t size() const { return products; }
+
+    /// Number of products of type TDerived
+    template<class TDerived>
+    std::size_t size() const
+    {
+        for (auto& seg : segments)
+            if (*seg.type==typeid(TDerived))
+                return seg.size;
+        return 0;
+    }
+
+    bool empty() const { return products==0; }
+
+    /// Number of concrete types stored
+    std::size_t types() const { return segments.size(); }
+
+    /// Destroy all products, in reverse order of construction per type
+    void clear()
+    {
+        for (auto& seg : segments) {
+            for (auto c = seg.chunks.rbegin(); c!=seg.chunks.rend(); ++c) {
+                for (std::size_t i = c->size; i-->0;)
+                    std::launder(reinterpret_cast<T*>(
+                            c->data+i*seg.stride+seg.offset))->~T();
+                ::operator delete(c->data, std::align_val_t(seg.align));
+            }
+        }
+        segments.clear();
+        products = 0;
+    }
+
+private:
+    static constexpr std::size_t first_chunk = 16;
+
+    template<typename ...Args>
+    static factory_methods<T, Args...> find_methods(std::string_view name)
+    {
+        auto found = map_holder<T, Args ...>::snapshot().find(name);
+        if (!found) {
+            auto args_str = print_args_types<Args...>();
+            throw factory_create_exception(std::string(name), args_str);
+        }
+        return *found;
+    }
+
+    template<typename ...Args>
+    T& construct(const factory_methods<T, Args...>& methods, segment& seg,
+                 Args&& ...args)
+    {
+        unsigned char* slot = seg.slot();
+        T* obj = methods.construct(slot, std::forward<Args>(args)...);
+        seg.constructed(slot, obj);
+        products++;
+        return *obj;
+    }
+
+    segment* find_segment(const std::type_info& type)
+    {
+        for (auto& seg : segments)
+            if (*seg.type==type)
+                return &seg;
+        return nullptr;
+    }
+
+    segment& segment_for(const std::type_info& type, std::size_t size,
+                         std::size_t align)
+    {
+        if (segment* seg = find_segment(type))
+            return *seg;
+        const std::size_t stride = (size+align-1)/align*align;
+        segments.push_back(segment{&type, stride, align, 0, {}, 0});
+        return segments.back();
+    }
+
+    template<typename ...Args>
+    segment& segment_for(const factory_methods<T, Args...>& methods)
+    {
+        return segment_for(*methods.type, methods.size, methods.align);
+    }
+
+    std::vector<segment> segments;
+    std::size_t products = 0;
+};
+
+
+}
+}
+
+#endif //PATTERNS_POLY_VECTOR_HPP
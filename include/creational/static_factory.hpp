@@ -34,8 +34,8 @@ public:
     {
         std::lock_guard<std::mutex> lock(map_holder<T>::mtx);
         unsigned long counter = 0;
-        for (auto it = map_holder<T>::clear_callbacks.begin();
-             it!=map_holder<T>::clear_callbacks.end(); ++it)
+        for (auto it = map_holder<T>::clear_callbacks().begin();
+             it!=map_holder<T>::clear_callbacks().end(); ++it)
         {
             if (std::get<0>(*it)==name)
                 counter++;
@@ -50,7 +50,8 @@ public:
      */
     static unsigned long registered()
     {
-        return map_holder<T>::clear_callbacks.size();
+        std::lock_guard<std::mutex> lock(map_holder<T>::mtx);
+        return map_holder<T>::clear_callbacks().size();
     }
 
     /**
@@ -61,11 +62,11 @@ public:
     {
         std::lock_guard<std::mutex> lock(map_holder<T>::mtx);
         int count = 0;
-        for (auto it = map_holder<T>::clear_callbacks.begin();
-             it!=map_holder<T>::clear_callbacks.end(); )
+        for (auto it = map_holder<T>::clear_callbacks().begin();
+             it!=map_holder<T>::clear_callbacks().end(); )
         {
             std::get<1>(*it)();
-            it = map_holder<T>::clear_callbacks.erase(it);
+            it = map_holder<T>::clear_callbacks().erase(it);
             count ++;
         }
         return count;
@@ -91,21 +92,23 @@ public:
         assert_type<TDerived>();
         std::lock_guard<std::mutex> lock(map_holder<T>::mtx);
 
-        if (map_holder<T>::functions.count(name)>0) {
+        if (map_holder<T>::functions().count(name)>0) {
             registration_error(name);
         }
-        map_holder<T>::functions[name] =
-                &create_unique<T, TDerived>;
+        map_holder<T>::functions()[name] =
+                make_factory_methods<T, TDerived>();
+        map_holder<T>::publish();
         clear_callback_tuple clt = std::make_tuple(name, []() {
-          map_holder<T>::functions.clear();
+          map_holder<T>::functions().clear();
+          map_holder<T>::publish();
         });
-        map_holder<T>::clear_callbacks.push_back(clt);
+        map_holder<T>::clear_callbacks().push_back(clt);
 
-        std::cout << "[----------] [OK]: " << static_factory<T>::name() <<": "
-                  << FBLU(demangle(typeid(TDerived).name()))
-                  << FBLU(" ()")
-                  << " registered under name " << FGRN(name)
-                  << std::endl;
+        PATTERNS_LOG_EVENT("static_factory", registered,
+                "[----------] [OK]: " << static_factory<T>::name() << ": "
+                        << FBLU(demangle(typeid(TDerived).name()))
+                        << FBLU(" ()")
+                        << " registered under name " << FGRN(name));
     };
 
     template<class TDerived, typename Arg0, typename ...Args>
@@ -113,53 +116,205 @@ public:
     {
         assert_type<TDerived>();
 
-        if (map_holder<T, Arg0, Args...>::functions.count(name)>0) {
-            registration_error(name);
-        }
         {
             std::lock_guard<std::mutex> lock(map_holder<T, Arg0, Args...>::mtx);
+            // checked under the lock of the insert, as concurrent
+            // registrations of a name must not both succeed
+            if (map_holder<T, Arg0, Args...>::functions().count(name)>0) {
+                registration_error(name);
+            }
             // Register static_factory method
-            map_holder<T, Arg0, Args...>::functions[name] =
-                    &create_unique<T, TDerived, Arg0, Args...>;
+            map_holder<T, Arg0, Args...>::functions()[name] =
+                    make_factory_methods<T, TDerived, Arg0, Args...>();
+            map_holder<T, Arg0, Args...>::publish();
         }
         {
             // Register static_factory method deleter
             clear_callback_tuple clt = std::make_tuple(name, []() {
-              map_holder<T, Arg0, Args...>::functions.clear();
+              std::lock_guard<std::mutex> lock(
+                      map_holder<T, Arg0, Args...>::mtx);
+              map_holder<T, Arg0, Args...>::functions().clear();
+              map_holder<T, Arg0, Args...>::publish();
             });
             std::lock_guard<std::mutex> lock(map_holder<T>::mtx);
-            map_holder<T>::clear_callbacks.push_back(clt);
+            map_holder<T>::clear_callbacks().push_back(clt);
         }
 
-        auto args_str = print_args_types<Arg0, Args...>();
-        std::cout << "[----------] [OK]: " << static_factory<T>::name() <<": "
-                  << FBLU(demangle(typeid(TDerived).name()))
-                  << FBLU(" (" << args_str << ")")
-                  << " registered under name " << FGRN(name)
-                  << std::endl;
+        PATTERNS_LOG_EVENT("static_factory", registered,
+                "[----------] [OK]: " << static_factory<T>::name() << ": "
+                        << FBLU(demangle(typeid(TDerived).name()))
+                        << FBLU(" (" << (print_args_types<Arg0, Args...>()) << ")")
+                        << " registered under name " << FGRN(name));
+    }
+    /**
+     * Register TDerived with pooled storage: destroyed products give their
+     * storage back to a per thread free list of TDerived, reused by the
+     * next creations on that thread
+     * @tparam TDerived
+     * @tparam Args     Constructor signature types
+     * @param name      Registration name
+     * @param capacity  Number of free blocks kept by every thread
+     */
+    template<class TDerived, typename ...Args>
+    static void register_pooled(const std::string& name, std::size_t capacity)
+    {
+        static_assert(std::has_virtual_destructor<T>::value,
+                "static_factory::register_pooled: "
+                        "T must have a virtual destructor");
+        object_pool<pooled<TDerived>>::reserve(capacity);
+        register_type<pooled<TDerived>, Args...>(name);
     }
+
     /**
      * Create instance by a registered name
      * @param name  The name of the registered class type
+     * @return      An instance of the requested class name
+     * @throw factory_create_exception if not found
+     */
+    template<typename ...Args>
+    static std::unique_ptr<T> create(std::string_view name, Args...args)
+    {
+        auto obj = try_create(name, std::forward<Args>(args)...);
+        if (!obj) {
+            auto args_str = print_args_types<Args...>();
+            throw factory_create_exception(std::string(name), args_str);
+        }
+        return obj;
+    }
+
+    /**
+     * Create instance by a registered name, without allocating for the
+     * lookup nor throwing on misses
+     * @param name  The name of the registered class type
      * @return      An instance of the requested class name, or null if not
      *              found.
      */
     template<typename ...Args>
-    static std::unique_ptr<T> create(const std::string& name, Args...args)
+    static std::unique_ptr<T> try_create(std::string_view name, Args...args)
     {
-        std::lock_guard<std::mutex> lock(map_holder<T, Args ...>::mtx);
-        try {
-            auto el = map_holder<T, Args ...>::functions.at(name);
-            return el(std::forward<Args>(args)...);
-        }
-        catch (std::exception& ex) {
+        auto found = map_holder<T, Args ...>::snapshot().find(name);
+        if (!found)
+            return nullptr;
+        // copied, the snapshot may be refreshed by nested creations
+        factory_method<T, Args...> method = found->create;
+        return method(std::forward<Args>(args)...);
+    }
+
+    /**
+     * Create count instances by a registered name, looking it up once
+     * @param name  The name of the registered class type
+     * @param count Number of instances
+     * @param args  Constructor arguments, copied for every instance
+     * @return      The instances
+     * @throw factory_create_exception if not found
+     */
+    template<typename ...Args>
+    static std::vector<std::unique_ptr<T>> create_n(std::string_view name,
+                                                   std::size_t count,
+                                                   Args...args)
+    {
+        std::vector<std::unique_ptr<T>> products(count);
+        create_batch(name, products.begin(), products.end(), args...);
+        return products;
+    }
+
+    /**
+     * Create instances by a registered name into [first, last), looking it
+     * up once
+     * @param name  The name of the registered class type
+     * @param first Output iterator to std::unique_ptr<T>
+     * @param last
+     * @param args  Constructor arguments, copied for every instance
+     * @throw factory_create_exception if not found
+     */
+    template<class OutputIt, typename ...Args>
+    static void create_batch(std::string_view name, OutputIt first,
+                             OutputIt last, Args...args)
+    {
+        create_products(find_methods<Args...>(name), first, last, args...);
+    }
+
+    /**
+     * Create count instances by a registered name in a single allocation
+     * @param name  The name of the registered class type
+     * @param count Number of instances
+     * @param args  Constructor arguments, copied for every instance
+     * @return      The instances, owned by the block
+     * @throw factory_create_exception if not found
+     */
+    template<typename ...Args>
+    static product_block<T> create_contiguous(std::string_view name,
+                                              std::size_t count,
+                                              Args...args)
+    {
+        return product_block<T>::construct(find_methods<Args...>(name),
+                count, args...);
+    }
+
+    /**
+     * Intern a registered name
+     * @tparam Args Constructor signature types
+     * @param name  The name of the registered class type
+     * @return      The key of the name, invalid if not found. Keys are
+     *              shared by all threads, and invalidated by clear.
+     */
+    template<typename ...Args>
+    static factory_key<T, Args...> key(std::string_view name)
+    {
+        return {map_holder<T, Args...>::snapshot().key(name)};
+    }
+
+    /**
+     * Create instance by an interned name
+     * @param key   The key of the registered class type
+     * @return      An instance of the requested class
+     * @throw factory_create_exception if the key is invalid or cleared
+     */
+    template<typename ...Args>
+    static std::unique_ptr<T> create(const factory_key<T, Args...>& key,
+                                     type_identity_t<Args>...args)
+    {
+        auto obj = try_create(key, std::forward<Args>(args)...);
+        if (!obj) {
             auto args_str = print_args_types<Args...>();
-            throw factory_create_exception(name, args_str);
+            throw factory_create_exception("#"+std::to_string(key.index),
+                    args_str);
         }
+        return obj;
+    }
+
+    /**
+     * Create instance by an interned name
+     * @param key   The key of the registered class type
+     * @return      An instance of the requested class, or null if the key
+     *              is invalid or cleared
+     */
+    template<typename ...Args>
+    static std::unique_ptr<T> try_create(const factory_key<T, Args...>& key,
+                                         type_identity_t<Args>...args)
+    {
+        auto found = map_holder<T, Args ...>::snapshot().find(key);
+        if (!found)
+            return nullptr;
+        factory_method<T, Args...> method = found->create;
+        return method(std::forward<Args>(args)...);
     }
+
 private:
     static_factory() = default;
 
+    /// Copy of the methods registered under name
+    template<typename ...Args>
+    static factory_methods<T, Args...> find_methods(std::string_view name)
+    {
+        auto found = map_holder<T, Args ...>::snapshot().find(name);
+        if (!found) {
+            auto args_str = print_args_types<Args...>();
+            throw factory_create_exception(std::string(name), args_str);
+        }
+        return *found;
+    }
+
     static void registration_error(const std::string& name)
     {
         throw factory_exception(
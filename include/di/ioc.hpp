@@ -1,11 +1,22 @@
 #ifndef PATTERNS_IOC_HPP
 #define PATTERNS_IOC_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <map>
 #include <memory>
+#include <memory_resource>
 #include <mutex>
+#include <new>
+#include <optional>
+#include <unordered_map>
 #include <vector>
 
 #include "exception.hpp"
+#include "util/log.hpp"
+#include "util/name_table.hpp"
 #include "util/text.hpp"
 #include "util/types.hpp"
 
@@ -14,6 +25,7 @@ namespace design_patterns {
 namespace di {
 
 #define IOC_MAX_RESOLVE_DEPTH 50
+#define IOC_PLAN_FRAME_SIZE 1024
 
 
 /// ioc exception
@@ -32,6 +44,962 @@ public:
                     "). It is possible that you have a dependency cycle.") { };
 };
 
+/// Dependency cycle exception, thrown when compiling the container
+class ioc_cycle_exception : public ioc_exception {
+public:
+    explicit ioc_cycle_exception(const std::string& cycle)
+            : ioc_exception("Dependency cycle detected: " + cycle) { };
+};
+
+/// Lifetime of the objects resolved from a registration
+enum class lifetime {
+    transient,      ///< A new object on every resolve
+    singleton,      ///< One object per container, built on first resolve
+    per_thread,     ///< One object per resolving thread
+    scoped          ///< One object per ioc_scope
+};
+
+/// Interned Type id name, see ioc_container::key
+typedef name_key ioc_key;
+
+namespace detail {
+
+/**
+ * Next free type slot. Slots are dense and shared by every container in the
+ * process, so a type keeps the same slot for its whole lifetime.
+ * @return  A new slot index
+ */
+inline std::size_t next_type_slot()
+{
+    static std::atomic<std::size_t> next_slot{0};
+    return next_slot++;
+}
+
+/**
+ * Slot of type T, assigned once the first time it is requested
+ * @tparam T
+ * @return  The slot index of T
+ */
+template<class T>
+std::size_t type_slot()
+{
+    static const std::size_t slot = next_type_slot();
+    return slot;
+}
+
+/// Type resolved for each of the supported forms
+template<class T, class = void>
+struct element_type { typedef T type; };
+
+template<class T>
+struct element_type<T, typename std::enable_if<
+        is_shared_ptr<T>::value||is_unique_ptr<T>::value>::type> {
+    typedef typename T::element_type type;
+};
+
+template<class T>
+struct element_type<T, typename std::enable_if<
+        std::is_pointer<T>::value>::type> {
+    typedef typename std::remove_pointer<T>::type type;
+};
+
+/// Form in which an object is resolved
+enum class ownership { raw, shared, unique, value };
+
+template<class T>
+struct ownership_of : std::integral_constant<ownership,
+        is_shared_ptr<T>::value ? ownership::shared :
+        is_unique_ptr<T>::value ? ownership::unique :
+        std::is_pointer<T>::value ? ownership::raw : ownership::value> {};
+
+/// Type stored while resolving T, raw pointers are stored type erased
+template<class T>
+using stored_type = typename std::conditional<
+        std::is_pointer<T>::value, void*, T>::type;
+
+/**
+ * Move a resolved T out of its storage, destroying the storage
+ * @tparam T
+ * @param storage
+ * @return
+ */
+template<class T>
+T take_stored(void* storage)
+{
+    if constexpr (std::is_pointer<T>::value) {
+        return static_cast<T>(*static_cast<void**>(storage));
+    }
+    else {
+        T* stored = static_cast<T*>(storage);
+        T obj(std::move(*stored));
+        stored->~T();
+        return obj;
+    }
+}
+
+/**
+ * Destroy a resolved T in its storage
+ * @tparam T
+ * @param storage
+ */
+template<class T>
+void destroy_stored(void* storage)
+{
+    typedef stored_type<T> stored;
+    static_cast<stored*>(storage)->~stored();
+}
+
+/**
+ * Monotonic arena of an ioc_scope. Transient objects built in the scope are
+ * carved from contiguous blocks and released together with the arena.
+ * Objects resolved as raw pointers are owned by the arena, and destroyed
+ * with it in reverse order of construction.
+ */
+class arena {
+public:
+    explicit arena(std::size_t size): resource(size), objects(&resource) { }
+
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+
+    ~arena() {
+        for (auto it = objects.rbegin(); it!=objects.rend(); ++it)
+            it->second(it->first);
+    }
+
+    template<class T, typename... Args>
+    std::shared_ptr<T> make_shared(Args&&... args)
+    {
+        return std::allocate_shared<T>(
+                std::pmr::polymorphic_allocator<T>(&resource),
+                std::forward<Args>(args)...);
+    }
+
+    template<class T, typename... Args>
+    T* make(Args&&... args)
+    {
+        objects.emplace_back(nullptr, &destroy<T>);
+        void* memory = resource.allocate(sizeof(T), alignof(T));
+        T* obj;
+        try {
+            obj = new (memory) T(std::forward<Args>(args)...);
+        }
+        catch (...) {
+            objects.pop_back();
+            throw;
+        }
+        objects.back().first = obj;
+        return obj;
+    }
+
+private:
+    template<class T>
+    static void destroy(void* obj)
+    {
+        static_cast<T*>(obj)->~T();
+    }
+
+    std::pmr::monotonic_buffer_resource resource;
+    std::pmr::vector<std::pair<void*, void(*)(void*)>> objects;
+};
+
+/**
+ * Construct T, registered as _Interface, directly in the requested form: a
+ * single allocation for shared pointers, adopted by unique pointers and in
+ * place for values. Objects are never copied. Shared pointers and raw
+ * pointers are carved from the arena, if any; unique pointers always own
+ * heap objects.
+ * @tparam _Interface
+ * @tparam T
+ * @tparam Args
+ * @param form      Requested form
+ * @param storage   Storage for the stored type of the form
+ * @param memory    Arena of the current scope, or null
+ * @param args      Constructor arguments
+ */
+template<class _Interface, class T, typename... Args>
+void construct(ownership form, void* storage, arena* memory, Args&&... args)
+{
+    switch (form) {
+    case ownership::shared:
+        if (memory)
+            new (storage) std::shared_ptr<_Interface>(
+                    memory->make_shared<T>(std::forward<Args>(args)...));
+        else
+            new (storage) std::shared_ptr<_Interface>(
+                    std::make_shared<T>(std::forward<Args>(args)...));
+        break;
+    case ownership::unique:
+        new (storage) std::unique_ptr<_Interface>(
+                new T(std::forward<Args>(args)...));
+        break;
+    case ownership::value:
+        if constexpr (std::is_constructible<_Interface, T&&>::value)
+            new (storage) _Interface(T(std::forward<Args>(args)...));
+        else
+            throw ioc_exception(demangle(typeid(_Interface).name())+
+                    " cannot be resolved by value");
+        break;
+    default:
+        if (memory)
+            new (storage) void*(static_cast<_Interface*>(
+                    memory->make<T>(std::forward<Args>(args)...)));
+        else
+            new (storage) void*(static_cast<_Interface*>(
+                    new T(std::forward<Args>(args)...)));
+    }
+}
+
+/// Object built while resolving. Objects cached by their lifetime are shared
+/// with their owner, transient objects have none.
+struct instance {
+    void* ptr;
+    const std::shared_ptr<void>* owner;
+};
+
+/// Build an object in the requested form from the objects already built by
+/// a resolution plan, destroying them once it is built
+typedef void (*build_method)(ownership form, void* storage, arena* memory,
+                             unsigned char* frame, const std::size_t* offsets);
+
+/// Convert an object to a requested form
+typedef void (*convert_method)(void* storage, const instance& obj);
+
+/// Build an object in the requested form
+typedef std::function<void(ownership form, void* storage)> make_method;
+
+/// Destroy an object built by a registration
+typedef void (*destroy_method)(void* obj);
+
+/**
+ * Destroy an object registered as _Interface
+ * @tparam _Interface
+ * @tparam T
+ * @param obj
+ */
+template<class _Interface, class T>
+void destroy_object(void* obj)
+{
+    delete static_cast<T*>(static_cast<_Interface*>(obj));
+}
+
+/**
+ * Next free instance cache id
+ * @return
+ */
+inline std::size_t next_cache_id()
+{
+    static std::atomic<std::size_t> next_id{0};
+    return next_id++;
+}
+
+/// Cached objects of a registration, shared by a container and its snapshots
+/// so that all of them resolve the same singleton.
+struct instance_cache {
+    const std::size_t id = next_cache_id();
+    std::atomic<void*> singleton{nullptr};
+    std::shared_ptr<void> owner;
+    std::recursive_mutex mtx;
+};
+
+/**
+ * Instance caches of the singleton registrations of a container by slot,
+ * read without locking. Segments double in size and are never moved, so
+ * entries stay in place while slots are added under the lock of the
+ * container.
+ */
+class singleton_index {
+public:
+    singleton_index() = default;
+    singleton_index(const singleton_index&) = delete;
+    singleton_index& operator=(const singleton_index&) = delete;
+
+    ~singleton_index()
+    {
+        for (auto& segment : segments)
+            delete[] segment.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Instance cache of the singleton in slot
+     * @param slot
+     * @return      The cache, or null if slot is not a singleton
+     */
+    instance_cache* find(std::size_t slot) const
+    {
+        std::size_t segment, offset;
+        locate(slot, segment, offset);
+        if (segment>=segment_count)
+            return nullptr;
+        auto* entries = segments[segment].load(std::memory_order_acquire);
+        return entries ? entries[offset].load(std::memory_order_acquire)
+                       : nullptr;
+    }
+
+    /**
+     * Enter the instance cache of the singleton in slot. Writers must be
+     * serialized.
+     * @param slot
+     * @param cache
+     */
+    void insert(std::size_t slot, instance_cache* cache)
+    {
+        std::size_t segment, offset;
+        locate(slot, segment, offset);
+        if (segment>=segment_count)
+            return;
+        auto* entries = segments[segment].load(std::memory_order_relaxed);
+        if (!entries) {
+            entries = new std::atomic<instance_cache*>[
+                    first_segment<<segment]();
+            segments[segment].store(entries, std::memory_order_release);
+        }
+        entries[offset].store(cache, std::memory_order_release);
+    }
+
+private:
+    static constexpr std::size_t first_segment = 16;
+    static constexpr std::size_t segment_count = 32;
+
+    /// Segment k holds the first_segment<<k slots from first_segment*(2^k-1)
+    static void locate(std::size_t slot, std::size_t& segment,
+                       std::size_t& offset)
+    {
+        segment = 0;
+        for (std::size_t n = slot/first_segment+1; n>1; n >>= 1)
+            ++segment;
+        offset = slot-first_segment*((std::size_t(1)<<segment)-1);
+    }
+
+    std::atomic<std::atomic<instance_cache*>*> segments[segment_count] = {};
+};
+
+/// Objects of the scoped registrations built in an ioc_scope, indexed by
+/// slot, destroyed in reverse order of construction.
+struct scope_instances {
+    std::vector<std::shared_ptr<void>> instances;
+    std::vector<std::size_t> order;
+
+    ~scope_instances() {
+        for (auto it = order.rbegin(); it!=order.rend(); ++it)
+            instances[*it].reset();
+    }
+};
+
+/// Constructor argument of a registered type, and how it is stored while
+/// resolving
+struct dependency {
+    std::size_t slot;
+    const std::type_info* type;
+    ownership form;
+    std::size_t size;
+    std::size_t align;
+    convert_method convert;
+    destroy_method destroy;
+};
+
+/// Registered type
+struct registration {
+    std::function<void*()> factory;
+    make_method make;
+    build_method build = nullptr;
+    destroy_method destroy = nullptr;
+    std::vector<dependency> dependencies;
+    const std::type_info* type = nullptr;
+    lifetime life = lifetime::transient;
+    std::shared_ptr<instance_cache> cache;
+    // entered in the string keyed map under the name of its type
+    bool named = false;
+};
+
+struct resolution_plan;
+
+/// Resolution plan step, builds an object either from previous steps,
+/// calling a registered factory method or fetching it from the cache of
+/// its lifetime. The object is stored in the frame of the plan, in the form
+/// requested by the step using it.
+struct plan_step {
+    build_method build;
+    const std::function<void*()>* factory;
+    const registration* cached;
+    const resolution_plan* plan;
+    std::size_t slot;
+    std::size_t first_arg;
+    std::size_t arg_count;
+    std::size_t parent;
+    std::size_t offset;
+    ownership form;
+    convert_method convert;
+    destroy_method destroy;
+};
+
+/// Flattened construction of a type, dependencies first. The last step builds
+/// the resolved object, in the storage of the caller.
+struct resolution_plan {
+    std::vector<plan_step> steps;
+    std::vector<std::size_t> args;
+    std::vector<std::size_t> offsets;
+    std::size_t frame_size = 0;
+};
+
+/// Registrations of a container and the plans compiled from them. Plan steps
+/// point into the registrations, so it is never modified once compiled.
+struct compiled_graph {
+    name_table<std::function<void*()>> map;
+    std::vector<registration> slots;
+    std::vector<resolution_plan> plans;
+};
+
+/**
+ * Convert to shared pointers, adopting transient objects
+ * @tparam T
+ * @param obj
+ * @return
+ */
+template<class T>
+typename std::enable_if<is_shared_ptr<T>::value==true,T>::type
+convert(const instance& obj)
+{
+    typedef typename T::element_type t_type;
+    t_type* o = static_cast<t_type*>(obj.ptr);
+    if (obj.owner)
+        return T(*obj.owner, o);
+    return T(o);
+}
+
+/**
+ * Convert to unique pointers, adopting transient objects
+ * @tparam T
+ * @param obj
+ * @return
+ */
+template<class T>
+typename std::enable_if<is_unique_ptr<T>::value==true,T>::type
+convert(const instance& obj)
+{
+    typedef typename T::element_type t_type;
+    t_type* o = static_cast<t_type*>(obj.ptr);
+    if (obj.owner)
+        throw ioc_exception("Cannot resolve a unique pointer to the shared "
+                "instance of "+demangle(typeid(t_type).name()));
+    return T(o);
+}
+
+/**
+ * Convert to objects passed by value, moving transient objects and copying
+ * shared ones
+ * @tparam T
+ * @param obj
+ * @return
+ */
+template<class T>
+typename std::enable_if<
+        std::is_object<T>::value==true&&
+                is_shared_ptr<T>::value==false&&
+                is_unique_ptr<T>::value==false&&
+                std::is_pointer<T>::value==false,T>::type
+convert(const instance& obj)
+{
+    T* o = static_cast<T*>(obj.ptr);
+    if (obj.owner) {
+        if constexpr (std::is_copy_constructible<T>::value)
+            return *o;
+        else
+            throw ioc_exception("Cannot copy the shared instance of "+
+                    demangle(typeid(T).name()));
+    }
+    std::unique_ptr<T> owned(o);
+    return std::move(*o);
+}
+
+/**
+ * Convert to raw pointers
+ * @tparam T
+ * @param obj
+ * @return
+ */
+template<class T>
+typename std::enable_if<std::is_pointer<T>::value==true,T>::type
+convert(const instance& obj)
+{
+    return static_cast<T>(obj.ptr);
+}
+
+/**
+ * Convert to T in its storage
+ * @tparam T
+ * @param storage
+ * @param obj
+ */
+template<class T>
+void convert_into(void* storage, const instance& obj)
+{
+    if constexpr (std::is_pointer<T>::value)
+        new (storage) void*(obj.ptr);
+    else
+        new (storage) T(convert<T>(obj));
+}
+
+/**
+ * Describe how a constructor argument of type T is resolved
+ * @tparam T
+ * @return
+ */
+template<class T>
+dependency make_dependency()
+{
+    typedef typename element_type<T>::type object_type;
+    return {type_slot<object_type>(), &typeid(object_type),
+            ownership_of<T>::value,
+            sizeof(stored_type<T>), alignof(stored_type<T>),
+            &convert_into<T>, &destroy_stored<T>};
+}
+
+/**
+ * Objects of the per_thread registrations built by the current thread, by
+ * instance cache id
+ * @return
+ */
+inline std::unordered_map<std::size_t, std::shared_ptr<void>>& thread_instances()
+{
+    thread_local std::unordered_map<std::size_t, std::shared_ptr<void>> instances;
+    return instances;
+}
+
+/**
+ * Get the object of a registration for its lifetime, building it when it is
+ * transient or not cached yet. Built singletons are read from an atomic
+ * pointer without locking.
+ * @tparam F
+ * @param reg       Registration
+ * @param slot      Slot of the registration
+ * @param scope     Current scope, if any
+ * @param build     Callable building a new object
+ * @return
+ */
+template<class F>
+instance fetch(const registration& reg, std::size_t slot,
+               scope_instances* scope, F&& build)
+{
+    switch (reg.life) {
+    case lifetime::singleton: {
+        instance_cache& cache = *reg.cache;
+        void* obj = cache.singleton.load(std::memory_order_acquire);
+        if (!obj) {
+            std::lock_guard<std::recursive_mutex> lock(cache.mtx);
+            obj = cache.singleton.load(std::memory_order_relaxed);
+            if (!obj) {
+                cache.owner = std::shared_ptr<void>(build(), reg.destroy);
+                obj = cache.owner.get();
+                cache.singleton.store(obj, std::memory_order_release);
+            }
+        }
+        return {obj, &cache.owner};
+    }
+    case lifetime::per_thread: {
+        std::shared_ptr<void>& owner = thread_instances()[reg.cache->id];
+        if (!owner)
+            owner = std::shared_ptr<void>(build(), reg.destroy);
+        return {owner.get(), &owner};
+    }
+    case lifetime::scoped: {
+        if (!scope)
+            throw ioc_exception(demangle(reg.type->name())+
+                    " has a scoped lifetime and can only be resolved "
+                    "from an ioc_scope");
+        std::shared_ptr<void>& owner = scope->instances[slot];
+        if (!owner) {
+            owner = std::shared_ptr<void>(build(), reg.destroy);
+            scope->order.push_back(slot);
+        }
+        return {owner.get(), &owner};
+    }
+    default:
+        return {build(), nullptr};
+    }
+}
+
+/**
+ * Walk every dependency of the type in slot, cached ones included, and
+ * throw if one leads back to a type being walked.
+ * @param graph Compiled registrations
+ * @param slot  Slot of the type to walk
+ * @param path  Slots being walked
+ * @param done  Slots whose dependencies were walked without a cycle
+ */
+inline void check_cycles(const compiled_graph& graph, std::size_t slot,
+                         std::vector<std::size_t>& path,
+                         std::vector<bool>& done)
+{
+    if (slot>=graph.slots.size() || !graph.slots[slot].factory || done[slot])
+        return;
+    auto cycle = std::find(path.begin(), path.end(), slot);
+    if (cycle!=path.end()) {
+        std::string names;
+        for (auto it = cycle; it!=path.end(); ++it)
+            names += demangle(graph.slots[*it].type->name())+" -> ";
+        throw ioc_cycle_exception(
+                names+demangle(graph.slots[slot].type->name()));
+    }
+    path.push_back(slot);
+    for (const auto& dependency : graph.slots[slot].dependencies)
+        check_cycles(graph, dependency.slot, path, done);
+    path.pop_back();
+    done[slot] = true;
+}
+
+/**
+ * Append the steps needed to build the type in slot, dependencies
+ * first, to a resolution plan. The graph must be free of cycles.
+ * @param graph Compiled registrations
+ * @param plan  Plan being compiled
+ * @param slot  Slot of the type to build
+ * @param type  Type to build, used to look it up in the string keyed map
+ * @param edge  Constructor argument built by the step, or null for the
+ *              type resolved by the plan. Other types with a cached
+ *              lifetime are fetched instead of built.
+ * @return      Index of the step building the type
+ */
+inline std::size_t compile_step(const compiled_graph& graph,
+                                resolution_plan& plan,
+                                std::size_t slot,
+                                const std::type_info& type,
+                                const dependency* edge = nullptr)
+{
+    plan_step step{};
+    step.slot = slot;
+    if (edge) {
+        step.form = edge->form;
+        step.convert = edge->convert;
+        step.destroy = edge->destroy;
+        step.offset = (plan.frame_size+edge->align-1)/edge->align*edge->align;
+        plan.frame_size = step.offset+edge->size;
+    }
+    if (slot>=graph.slots.size() || !graph.slots[slot].factory) {
+        step.factory = graph.map.find(type.name());
+        if (!step.factory)
+            throw ioc_exception(
+                    "Could not locate type in IOC under name "+
+                            demangle(type.name()));
+        plan.steps.push_back(step);
+        return plan.steps.size()-1;
+    }
+    const registration& reg = graph.slots[slot];
+    if (edge && reg.life!=lifetime::transient) {
+        step.cached = &reg;
+        step.plan = &graph.plans[slot];
+        plan.steps.push_back(step);
+        return plan.steps.size()-1;
+    }
+    if (!reg.build) {
+        step.factory = &reg.factory;
+        plan.steps.push_back(step);
+        return plan.steps.size()-1;
+    }
+    std::vector<std::size_t> args;
+    for (const auto& dependency : reg.dependencies)
+        args.push_back(compile_step(graph, plan, dependency.slot,
+                *dependency.type, &dependency));
+    step.build = reg.build;
+    step.first_arg = plan.args.size();
+    step.arg_count = args.size();
+    plan.steps.push_back(step);
+    for (auto arg : args) {
+        plan.steps[arg].parent = plan.steps.size()-1;
+        plan.args.push_back(arg);
+        plan.offsets.push_back(plan.steps[arg].offset);
+    }
+    return plan.steps.size()-1;
+}
+
+/**
+ * Frame of a plan too large for the stack. The buffer is kept for the next
+ * plan run on the same thread instead of going back to the heap, where
+ * blocks of this size are not cached; nested runs allocate their own.
+ */
+class heap_frame {
+public:
+    explicit heap_frame(std::size_t size)
+    {
+        spare_buffer& spare = heap_frame::spare();
+        if (spare.size>=size) {
+            buffer = std::move(spare.buffer);
+            capacity = spare.size;
+            spare.size = 0;
+        }
+        else {
+            buffer.reset(new unsigned char[size]);
+            capacity = size;
+        }
+    }
+
+    ~heap_frame()
+    {
+        spare_buffer& spare = heap_frame::spare();
+        if (capacity>spare.size) {
+            spare.buffer = std::move(buffer);
+            spare.size = capacity;
+        }
+    }
+
+    heap_frame(const heap_frame&) = delete;
+    heap_frame& operator=(const heap_frame&) = delete;
+
+    unsigned char* get() const { return buffer.get(); }
+
+private:
+    struct spare_buffer {
+        std::unique_ptr<unsigned char[]> buffer;
+        std::size_t size = 0;
+    };
+
+    static spare_buffer& spare()
+    {
+        static thread_local spare_buffer buffer;
+        return buffer;
+    }
+
+    std::unique_ptr<unsigned char[]> buffer;
+    std::size_t capacity;
+};
+
+/**
+ * Run the steps of a resolution plan. Every step builds its object in the
+ * frame, in the form requested by the step using it, which moves it out.
+ * Objects left in the frame by a failing step are destroyed.
+ * @param plan
+ * @param form      Form of the resolved object
+ * @param convert   Conversion of the resolved object to its form
+ * @param storage   Storage for the resolved object
+ * @param scope     Current scope, if any
+ * @param memory    Arena of the current scope for transient objects, if any
+ */
+void run_plan(const resolution_plan& plan, ownership form,
+              convert_method convert, void* storage, scope_instances* scope,
+              arena* memory);
+
+/**
+ * Build a new object of a plan owned by the caller. Objects outliving the
+ * current scope, as cached ones do, are never built in its arena.
+ * @param plan
+ * @param scope     Current scope, if any
+ * @return
+ */
+inline void* build_owned(const resolution_plan& plan, scope_instances* scope)
+{
+    void* obj;
+    run_plan(plan, ownership::raw, &convert_into<void*>, &obj, scope, nullptr);
+    return obj;
+}
+
+inline void run_plan(const resolution_plan& plan, ownership form,
+                     convert_method convert, void* storage,
+                     scope_instances* scope, arena* memory)
+{
+    alignas(std::max_align_t) unsigned char stack_frame[IOC_PLAN_FRAME_SIZE];
+    std::optional<heap_frame> large_frame;
+    unsigned char* frame = stack_frame;
+    if (plan.frame_size>IOC_PLAN_FRAME_SIZE) {
+        large_frame.emplace(plan.frame_size);
+        frame = large_frame->get();
+    }
+    const std::size_t last = plan.steps.size()-1;
+    std::size_t i = 0;
+    try {
+        for (; i<plan.steps.size(); ++i) {
+            const plan_step& step = plan.steps[i];
+            void* target = i==last ? storage : frame+step.offset;
+            const ownership target_form = i==last ? form : step.form;
+            const convert_method target_convert =
+                    i==last ? convert : step.convert;
+            if (step.build) {
+                step.build(target_form, target, memory, frame,
+                        plan.offsets.data()+step.first_arg);
+            }
+            else if (step.factory) {
+                target_convert(target, {(*step.factory)(), nullptr});
+            }
+            else {
+                target_convert(target, fetch(*step.cached, step.slot, scope,
+                        [&]() { return build_owned(*step.plan, scope); }));
+            }
+        }
+    }
+    catch (...) {
+        for (std::size_t j = 0; j<i; ++j) {
+            if (plan.steps[j].parent>=i)
+                plan.steps[j].destroy(frame+plan.steps[j].offset);
+        }
+        throw;
+    }
+}
+
+/**
+ * Resolve the type in slot, running its plan, for the string keyed map: a
+ * new object owned by the caller, or the one cached for its lifetime
+ * @param graph
+ * @param slot
+ * @return
+ */
+inline void* resolve_raw(const compiled_graph& graph, std::size_t slot)
+{
+    const registration& reg = graph.slots[slot];
+    if (reg.life==lifetime::transient)
+        return build_owned(graph.plans[slot], nullptr);
+    return fetch(reg, slot, nullptr, [&]() {
+      return build_owned(graph.plans[slot], nullptr);
+    }).ptr;
+}
+
+/**
+ * Resolve T, the type in slot, running its plan
+ * @tparam T
+ * @param graph
+ * @param slot
+ * @param scope     Current scope, if any
+ * @param memory    Arena of the current scope for transient objects, if any
+ * @return
+ */
+template<class T>
+T resolve_plan(const compiled_graph& graph, std::size_t slot,
+               scope_instances* scope, arena* memory = nullptr)
+{
+    alignas(stored_type<T>) unsigned char storage[sizeof(stored_type<T>)];
+    const registration& reg = graph.slots[slot];
+    if (reg.life==lifetime::transient) {
+        run_plan(graph.plans[slot], ownership_of<T>::value, &convert_into<T>,
+                storage, scope, memory);
+    }
+    else {
+        convert_into<T>(storage, fetch(reg, slot, scope, [&]() {
+          return build_owned(graph.plans[slot], scope);
+        }));
+    }
+    return take_stored<T>(storage);
+}
+
+}
+
+/**
+ * Immutable snapshot of a compiled ioc_container. Resolves neither lock nor
+ * touch shared mutable state: compiled plans are run as a loop over their
+ * steps, so there is no recursion depth to track. Any number of threads can
+ * resolve from the same snapshot, which is cheap to copy.
+ */
+class ioc_snapshot {
+public:
+    /**
+     * Resolve by Type
+     * @tparam T
+     * @return
+     */
+    template<class T>
+    T resolve() const
+    {
+        return resolve_in<T>(nullptr);
+    }
+
+    /**
+     * Resolve by Type id name
+     * @tparam T
+     * @param id
+     * @return
+     */
+    template<class T>
+    T* resolve(const std::string& id) const
+    {
+        if (auto factory = graph->map.find(id))
+            return static_cast<T*>((*factory)());
+        throw std::runtime_error(
+                "Could not locate type in IOC under name "+ id);
+    }
+
+    /**
+     * Resolve by interned Type id name, see ioc_container::key
+     * @tparam T
+     * @param key
+     * @return
+     */
+    template<class T>
+    T* resolve(ioc_key key) const
+    {
+        if (auto factory = graph->map.find(key))
+            return static_cast<T*>((*factory)());
+        throw std::runtime_error("Could not locate type in IOC under key "+
+                std::to_string(key.index));
+    }
+
+private:
+    friend class ioc_container;
+    friend class ioc_scope;
+
+    explicit ioc_snapshot(std::shared_ptr<const detail::compiled_graph> graph)
+            : graph(std::move(graph)) { }
+
+    std::shared_ptr<const detail::compiled_graph> graph;
+
+    template<class T>
+    T resolve_in(detail::scope_instances* scope,
+                 detail::arena* memory = nullptr) const
+    {
+        typedef typename detail::element_type<T>::type object_type;
+        const std::size_t slot = detail::type_slot<object_type>();
+        if (slot<graph->plans.size() && !graph->plans[slot].steps.empty())
+            return detail::resolve_plan<T>(*graph, slot, scope, memory);
+        return detail::convert<T>(detail::instance{
+                resolve<object_type>(typeid(object_type).name()), nullptr});
+    }
+};
+
+/**
+ * Resolution scope of a snapshot, e.g. one per request. Types registered
+ * with a scoped lifetime are built once per scope and destroyed with it, in
+ * reverse order of construction. A scope is used from one thread at a time.
+ *
+ * A scope may be bound to a monotonic arena: transient objects resolved in
+ * it as shared or raw pointers are then carved from the arena and released
+ * together when the scope ends, instead of being allocated one by one. Raw
+ * pointers are owned by the scope, and no object may outlive it.
+ */
+class ioc_scope {
+public:
+    explicit ioc_scope(ioc_snapshot snapshot): snapshot(std::move(snapshot))
+    {
+        instances.instances.resize(this->snapshot.graph->slots.size());
+    }
+
+    /**
+     * Scope bound to an arena
+     * @param snapshot
+     * @param arena_size    Size of the first block of the arena, in bytes
+     */
+    ioc_scope(ioc_snapshot snapshot, std::size_t arena_size)
+            : ioc_scope(std::move(snapshot))
+    {
+        memory.emplace(arena_size);
+    }
+
+    ioc_scope(const ioc_scope&) = delete;
+    ioc_scope& operator=(const ioc_scope&) = delete;
+
+    /**
+     * Resolve by Type
+     * @tparam T
+     * @return
+     */
+    template<class T>
+    T resolve()
+    {
+        return snapshot.resolve_in<T>(&instances,
+                memory ? &*memory : nullptr);
+    }
+
+private:
+    ioc_snapshot snapshot;
+    std::optional<detail::arena> memory;
+    detail::scope_instances instances;
+};
+
 class ioc_container {
 public:
 
@@ -42,10 +1010,13 @@ public:
      * @param obj
      */
     template<class T>
-    void register_type(std::function<T*()> obj)
+    void register_type(std::function<T*()> obj,
+                       lifetime life = lifetime::transient)
     {
-        const std::type_info* type_id = &typeid(T);
-        register_type(type_id->name(), obj);
+        detail::registration reg;
+        reg.factory = obj;
+        reg.destroy = &detail::destroy_object<T, T>;
+        register_slot<T>(std::move(reg), life);
     }
 
     /**
@@ -64,14 +1035,30 @@ public:
         register_type(type_id->name(), obj);
     }
 
+    /**
+     * Register _Derived as the implementation of _Interface, built from its
+     * constructor taking _Args
+     * @tparam _Interface
+     * @tparam _Derived
+     * @tparam _Args
+     * @param life  Lifetime of the resolved objects
+     */
     template<typename _Interface, typename _Derived = _Interface, typename..._Args>
-    void register_type()
+    void register_type(lifetime life = lifetime::transient)
     {
         static_assert(std::is_base_of<_Interface, _Derived>::value,
                 "ioc_container::() _Derived must be derived from _Interface");
-        const std::type_info* type_id = &typeid(_Interface);
-        auto factory_method = make_factory<_Derived, _Args...>();
-        register_type(type_id->name(), factory_method);
+        detail::registration reg;
+        reg.make = make_factory<_Interface, _Derived, _Args...>();
+        reg.factory = [make = reg.make]() {
+          void* obj;
+          make(detail::ownership::raw, &obj);
+          return obj;
+        };
+        reg.build = &build_object<_Interface, _Derived, _Args...>;
+        reg.destroy = &detail::destroy_object<_Interface, _Derived>;
+        reg.dependencies = {detail::make_dependency<_Args>()...};
+        register_slot<_Interface>(std::move(reg), life);
     }
 
     /**
@@ -85,49 +1072,133 @@ public:
     template<class T>
     void register_type(const std::string& id, std::function<T*()> obj)
     {
-        auto iter = m_map.find(id);
-        if (iter==m_map.end()) {
+        if (!m_map.find(id)) {
             m_map[id] = obj;
-            std::cout << "Registered raw TypeID="
-                      << demangle(id.c_str())
-                      << "("<< id << ")"
-                      << std::endl;
+            m_compiled.reset();
+            PATTERNS_LOG_EVENT("ioc", registered, "Registered raw TypeID="
+                    << demangle(id.c_str()) << "(" << id << ")");
         }
     }
 
     /**
-     * Resolve by Type
+     * Resolve by Type. Singletons already built are read without locking
+     * the container.
      * @tparam T
      * @return
      */
     template<class T>
     T resolve()
     {
+        typedef typename detail::element_type<T>::type object_type;
+        const std::size_t slot = detail::type_slot<object_type>();
+        if (detail::instance_cache* cache = m_singletons.find(slot)) {
+            if (void* obj = cache->singleton.load(std::memory_order_acquire))
+                return detail::convert<T>(detail::instance{obj, &cache->owner});
+        }
         std::lock_guard<std::mutex> lock(mtx);
+        if (m_compiled) {
+            const auto& plans = m_compiled->plans;
+            if (slot<plans.size() && !plans[slot].steps.empty())
+                return detail::resolve_plan<T>(*m_compiled, slot, nullptr);
+        }
         current_depth = 0;
         return resolve_internal<T>();
     }
 
     /**
-     * Resolve by Type id name
+     * Resolve by Type id name. This is the string keyed path, types registered
+     * through their type are found by the name of their typeid. Objects with
+     * a singleton or per thread lifetime stay owned by the container, scoped
+     * ones cannot be resolved by name.
      * @tparam T
      * @param id
      * @return
      */
     template<class T>
-    T resolve(const std::string& id)
+    T* resolve(const std::string& id)
     {
         std::lock_guard<std::mutex> lock(mtx);
         current_depth = 0;
         return resolve_internal<T>(id);
     }
 
+    /**
+     * Intern a Type id name, types registered through their type have the
+     * name of their typeid. Resolving by key indexes the registration
+     * instead of looking the name up. Registrations are never removed, so
+     * keys stay valid for the container and all its snapshots, from any
+     * thread.
+     * @param id
+     * @return      The key of id, or an invalid key if not registered
+     */
+    ioc_key key(const std::string& id)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return m_map.key(id);
+    }
+
+    /**
+     * Resolve by interned Type id name
+     * @tparam T
+     * @param key
+     * @return
+     */
+    template<class T>
+    T* resolve(ioc_key key)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        current_depth = 0;
+        if (auto factory = m_map.find(key))
+            return static_cast<T*>((*factory)());
+        throw std::runtime_error("Could not locate type in IOC under key "+
+                std::to_string(key.index));
+    }
+
+    /**
+     * Validate the dependency graph of every registered type and compile a
+     * flattened resolution plan for each of them. Resolves of compiled types
+     * run their plan without lookups or recursion checks. Registering a type
+     * afterwards discards the plans until compile() is called again.
+     * @throws ioc_cycle_exception  Naming the types of a dependency cycle
+     * @throws ioc_exception        If a dependency is not registered
+     */
+    void compile()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        compile_graph();
+    }
+
+    /**
+     * Whether resolves run compiled plans
+     * @return
+     */
+    bool is_compiled()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return m_compiled!=nullptr;
+    }
+
+    /**
+     * Compile the container, if needed, and take an immutable snapshot of
+     * it for lock free concurrent resolves. Later registrations do not
+     * affect the snapshot.
+     * @return
+     */
+    ioc_snapshot freeze()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!m_compiled)
+            compile_graph();
+        return ioc_snapshot(m_compiled);
+    }
+
     ioc_container() = default;
     explicit ioc_container(int max_depth): max_depth(max_depth){};
 private:
-    typedef std::function<void*()> factory_method;
-
-    std::map<std::string, std::function<void*()>> m_map;
+    name_table<std::function<void*()>> m_map;
+    std::vector<detail::registration> m_slots;
+    std::shared_ptr<const detail::compiled_graph> m_compiled;
+    detail::singleton_index m_singletons;
     std::mutex mtx;
     const int max_depth = IOC_MAX_RESOLVE_DEPTH;
     int current_depth = 0;
@@ -145,111 +1216,206 @@ private:
         current_depth++;
     }
 
-    template<class T>
-    T* resolve_internal(const std::string& id)
+    /**
+     * Compile a plan for every registered type from a copy of the
+     * registrations
+     */
+    void compile_graph()
     {
-        std::cout << "Resolving for: " << id << std::endl;
-        auto iter = m_map.find(id);
-        if (iter!=m_map.end()) {
-            return static_cast<T*>(iter->second());
+        auto graph = std::make_shared<detail::compiled_graph>();
+        graph->map = m_map;
+        graph->slots = m_slots;
+        graph->plans.resize(m_slots.size());
+        std::vector<std::size_t> path;
+        std::vector<bool> done(m_slots.size());
+        for (std::size_t slot = 0; slot<m_slots.size(); ++slot)
+            detail::check_cycles(*graph, slot, path, done);
+        for (std::size_t slot = 0; slot<m_slots.size(); ++slot) {
+            if (m_slots[slot].factory)
+                detail::compile_step(*graph, graph->plans[slot], slot,
+                        *m_slots[slot].type);
         }
-        throw std::runtime_error(
-                "Could not locate type in IOC under name "+ id);
+        // the container entries resolve through the container, the graph
+        // ones through its plans, so snapshots never call back into it
+        const detail::compiled_graph* compiled = graph.get();
+        for (std::size_t slot = 0; slot<m_slots.size(); ++slot) {
+            if (m_slots[slot].named) {
+                graph->map[m_slots[slot].type->name()] = [compiled, slot]() {
+                  return detail::resolve_raw(*compiled, slot);
+                };
+            }
+        }
+        m_compiled = std::move(graph);
     }
 
     /**
-     * Resolve shared pointers
+     * Register a type in the slot of T. As in the string keyed map, the
+     * first registration of a type wins. The registration is also entered
+     * in the string keyed map under the name of the typeid of T, unless
+     * already taken, resolving through the lifetime of the registration.
+     * Snapshots replace the entry with one running the compiled plan.
      * @tparam T
-     * @return
+     * @param reg
+     * @param life
      */
     template<class T>
-    typename std::enable_if<is_shared_ptr<T>::value==true,T>::type
-    resolve_internal()
+    void register_slot(detail::registration reg, lifetime life)
     {
-        check_recursion_depth();
-        typedef typename T::element_type t_type;
-        const std::type_info* type_id = &typeid(t_type);
-        t_type* o = resolve_internal<t_type>(type_id->name());
-        std::cout << "Making shared " << type_id->name() << std::endl;
-        return std::make_shared<t_type>(*o);
+        std::lock_guard<std::mutex> lock(mtx);
+        const std::size_t slot = detail::type_slot<T>();
+        if (slot>=m_slots.size())
+            m_slots.resize(slot+1);
+        if (!m_slots[slot].factory) {
+            reg.type = &typeid(T);
+            reg.life = life;
+            if (life!=lifetime::transient)
+                reg.cache = std::make_shared<detail::instance_cache>();
+            if (!m_map.find(typeid(T).name())) {
+                reg.named = true;
+                m_map[typeid(T).name()] = [this, slot]() {
+                  const detail::registration& named = m_slots[slot];
+                  return detail::fetch(named, slot, nullptr,
+                          named.factory).ptr;
+                };
+            }
+            m_slots[slot] = std::move(reg);
+            if (life==lifetime::singleton)
+                m_singletons.insert(slot, m_slots[slot].cache.get());
+            m_compiled.reset();
+            PATTERNS_LOG_EVENT("ioc", registered, "Registered TypeID="
+                    << demangle(typeid(T).name()) << " in slot " << slot);
+        }
     }
 
     /**
-     * Resolve unique pointers
+     * Resolve T from its slot, falling back to the string keyed map for
+     * types registered through a type_info or a custom id.
      * @tparam T
      * @return
      */
     template<class T>
-    typename std::enable_if<is_unique_ptr<T>::value==true,T>::type
-    resolve_internal()
+    detail::instance resolve_slot()
     {
-        check_recursion_depth();
-        typedef typename T::element_type t_type;
-        const std::type_info* type_id = &typeid(t_type);
-        t_type* o = resolve_internal<t_type>(type_id->name());
-        std::cout << "Making unique " << type_id->name() << std::endl;
-        return std::make_unique<t_type>(*o);
+        const std::size_t slot = detail::type_slot<T>();
+        if (slot<m_slots.size() && m_slots[slot].factory) {
+            const detail::registration& reg = m_slots[slot];
+            return detail::fetch(reg, slot, nullptr, reg.factory);
+        }
+        return {resolve_internal<T>(typeid(T).name()), nullptr};
+    }
+
+    template<class T>
+    T* resolve_internal(const std::string& id)
+    {
+        PATTERNS_LOG_EVENT("ioc", resolving, "Resolving for: " << id);
+        if (auto factory = m_map.find(id))
+            return static_cast<T*>((*factory)());
+        throw std::runtime_error(
+                "Could not locate type in IOC under name "+ id);
     }
 
     /**
-     * Resolve Objects passed by value
+     * Resolve any of the supported forms (shared, unique, raw pointer or
+     * value), guarding the recursion depth of the current resolution.
      * @tparam T
      * @return
      */
     template<class T>
-    typename std::enable_if<
-            std::is_object<T>::value==true&&
-                    is_shared_ptr<T>::value==false&&
-                    is_unique_ptr<T>::value==false&&
-                    std::is_pointer<T>::value==false,T>::type
-    resolve_internal()
+    T resolve_internal()
     {
+        typedef typename detail::element_type<T>::type object_type;
         check_recursion_depth();
-        const std::type_info* type_id = &typeid(T);
-        T *o = resolve_internal<T>(type_id->name());
-        return *o;
+        const std::size_t slot = detail::type_slot<object_type>();
+        if (slot<m_slots.size() && m_slots[slot].make &&
+                m_slots[slot].life==lifetime::transient) {
+            alignas(detail::stored_type<T>)
+                    unsigned char storage[sizeof(detail::stored_type<T>)];
+            m_slots[slot].make(detail::ownership_of<T>::value, storage);
+            current_depth--;
+            return detail::take_stored<T>(storage);
+        }
+        T obj = detail::convert<T>(resolve_slot<object_type>());
+        current_depth--;
+        return obj;
     }
 
     /**
-     * Resolve Raw Pointers
+     * Factory Method creator, the method builds the object directly in the
+     * requested form
+     * @tparam _Interface
      * @tparam T
+     * @tparam Args
      * @return
      */
-    template<class T>
-    typename std::enable_if<std::is_pointer<T>::value==true,T>::type
-    resolve_internal()
+    template<class _Interface, class T, typename... Args>
+    detail::make_method make_factory()
     {
-        check_recursion_depth();
-        typedef typename std::remove_pointer<T>::type object_type;
-        const std::type_info* type_id = &typeid(object_type);
-        return resolve_internal<object_type>(type_id->name());
+        detail::make_method factory_fn = [&](detail::ownership form,
+                                              void* storage) {
+          PATTERNS_LOG_EVENT("ioc", making,
+                  "Making " << demangle(typeid(T).name()) << " ()");
+          detail::construct<_Interface, T>(form, storage, nullptr,
+                  resolve_internal<Args>()...);
+        };
+        return factory_fn;
     }
 
     /**
-     * Factory Method creator
+     * Build method creator, constructs T in the requested form from the
+     * objects already built by the previous steps of a resolution plan,
+     * destroying them once it is built.
+     * @tparam _Interface
      * @tparam T
      * @tparam Args
+     * @param form      Requested form
+     * @param storage   Storage for the built object
+     * @param memory    Arena of the current scope, or null
+     * @param frame     Frame of the plan
+     * @param offsets   Offsets of the constructor arguments in the frame
+     */
+    template<class _Interface, class T, typename... Args>
+    static void build_object(detail::ownership form, void* storage,
+                             detail::arena* memory, unsigned char* frame,
+                             const std::size_t* offsets)
+    {
+        build_object_from<_Interface, T, Args...>(form, storage, memory,
+                frame, offsets, std::index_sequence_for<Args...>{});
+    }
+
+    template<class _Interface, class T, typename... Args, std::size_t... I>
+    static void build_object_from(detail::ownership form, void* storage,
+                                  detail::arena* memory,
+                                  unsigned char* frame,
+                                  const std::size_t* offsets,
+                                  std::index_sequence<I...>)
+    {
+        PATTERNS_LOG_EVENT("ioc", making,
+                "Making " << demangle(typeid(T).name()) << " ()");
+        detail::construct<_Interface, T>(form, storage, memory,
+                take_argument<Args>(frame+offsets[I])...);
+        (detail::destroy_stored<Args>(frame+offsets[I]), ...);
+    }
+
+    /**
+     * Constructor argument built in the frame of a plan
+     * @tparam T
+     * @param storage
      * @return
      */
-    template<class T, typename... Args>
-    factory_method make_factory()
-    {
-        factory_method factory_fn = [&]() -> T* {
-          std::cout << "Making "
-                    << demangle(typeid(T).name())
-                    << " ()"
-                    << std::endl;
-          T* obj;
-          if constexpr((sizeof...(Args) > 0)) {
-              obj = new T(resolve_internal<Args>()...);
-          }else {
-              obj = new T();
-          }
-          current_depth--;
-          return obj;
-        };
-        return factory_fn;
+    template<class T>
+    static typename std::enable_if<std::is_pointer<T>::value, T>::type
+    take_argument(void* storage)
+    {
+        return static_cast<T>(*static_cast<void**>(storage));
     }
+
+    template<class T>
+    static typename std::enable_if<!std::is_pointer<T>::value, T&&>::type
+    take_argument(void* storage)
+    {
+        return std::move(*static_cast<T*>(storage));
+    }
+
 };
 
 }
@@ -0,0 +1,105 @@
+#ifndef PATTERNS_UTIL_LOG_HPP
+#define PATTERNS_UTIL_LOG_HPP
+
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+/**
+ * Logging of the patterns, selected at compile time. With PATTERNS_LOG=0
+ * log statements compile to nothing: no I/O and no string formatting. With
+ * PATTERNS_LOG=1 messages are formatted and passed to the installed sink,
+ * std::cout by default, unless the sink is null. Unless defined, logging is
+ * disabled in Release (NDEBUG) builds.
+ */
+#ifndef PATTERNS_LOG
+#ifdef NDEBUG
+#define PATTERNS_LOG 0
+#else
+#define PATTERNS_LOG 1
+#endif
+#endif
+
+namespace design_patterns {
+namespace log {
+
+
+/// Logged event
+enum class event { registered, resolving, making, destroyed };
+
+/// Structured log record
+struct record {
+    const char* component;
+    log::event event;
+    const std::string& message;
+};
+
+typedef void (*sink_method)(const record& rec);
+
+/// Whether log statements are compiled in
+constexpr bool enabled = PATTERNS_LOG!=0;
+
+inline void cout_sink(const record& rec)
+{
+    std::cout << rec.message << std::endl;
+}
+
+inline std::atomic<sink_method>& current_sink()
+{
+    static std::atomic<sink_method> sink{&cout_sink};
+    return sink;
+}
+
+/**
+ * Installed sink, null if records are discarded
+ * @return
+ */
+inline sink_method sink()
+{
+    return current_sink().load(std::memory_order_acquire);
+}
+
+/**
+ * Install a sink, null discards all records without formatting them. Safe
+ * to call while other threads log.
+ * @param sink
+ * @return      The previous sink
+ */
+inline sink_method set_sink(sink_method sink)
+{
+    return current_sink().exchange(sink, std::memory_order_acq_rel);
+}
+
+inline void write(const char* component, log::event event,
+                  const std::string& message)
+{
+    if (sink_method installed = sink())
+        installed(record{component, event, message});
+}
+
+
+}
+}
+
+/**
+ * Log a message streamed from expr, e.g.
+ * PATTERNS_LOG_EVENT("ioc", registered, "Registered " << name)
+ */
+#if PATTERNS_LOG
+#define PATTERNS_LOG_EVENT(component, kind, expr)                            \
+    do {                                                                     \
+        if (::design_patterns::log::sink()) {                                \
+            std::ostringstream patterns_log_message;                         \
+            patterns_log_message << expr;                                    \
+            ::design_patterns::log::write(component,                         \
+                    ::design_patterns::log::event::kind,                     \
+                    patterns_log_message.str());                             \
+        }                                                                    \
+    } while (0)
+#else
+#define PATTERNS_LOG_EVENT(component, kind, expr) do { } while (0)
+#endif
+
+
+#endif //PATTERNS_UTIL_LOG_HPP
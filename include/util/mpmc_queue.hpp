@@ -0,0 +1,126 @@
+#ifndef PATTERNS_UTIL_MPMC_QUEUE_HPP
+#define PATTERNS_UTIL_MPMC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace design_patterns {
+
+
+/**
+ * Bounded lock free queue for multiple producers and consumers. Every cell
+ * carries a sequence number telling producers and consumers whose turn it
+ * is, so pushes and pops only contend on their own position counter.
+ * @tparam T    Default constructible and move assignable
+ */
+template<class T>
+class mpmc_queue {
+public:
+    /**
+     * @param capacity  Rounded up to a power of two
+     */
+    explicit mpmc_queue(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while (size<capacity)
+            size *= 2;
+        mask = size-1;
+        cells = std::make_unique<cell[]>(size);
+        for (std::size_t i = 0; i<size; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    mpmc_queue(const mpmc_queue&) = delete;
+    mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+    std::size_t capacity() const
+    {
+        return mask+1;
+    }
+
+    /// Number of values, exact when no push or pop is in progress
+    std::size_t size() const
+    {
+        const std::size_t tail = dequeue_pos.load();
+        const std::size_t head = enqueue_pos.load();
+        return head>tail ? head-tail : 0;
+    }
+
+    bool empty() const
+    {
+        return size()==0;
+    }
+
+    /**
+     * Push a value
+     * @param value
+     * @return  False if full, value is untouched
+     */
+    bool try_push(T&& value)
+    {
+        std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell& c = cells[pos & mask];
+            const std::size_t seq = c.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq-pos);
+            if (diff==0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos+1,
+                        std::memory_order_relaxed)) {
+                    c.value = std::move(value);
+                    c.sequence.store(pos+1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff<0)
+                return false;
+            else
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Pop the oldest value
+     * @param value
+     * @return  False if empty
+     */
+    bool try_pop(T& value)
+    {
+        std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell& c = cells[pos & mask];
+            const std::size_t seq = c.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq-(pos+1));
+            if (diff==0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos+1,
+                        std::memory_order_relaxed)) {
+                    value = std::move(c.value);
+                    c.value = T();
+                    c.sequence.store(pos+mask+1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff<0)
+                return false;
+            else
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+private:
+    struct cell {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<cell[]> cells;
+    std::size_t mask = 0;
+    alignas(64) std::atomic<std::size_t> enqueue_pos{0};
+    alignas(64) std::atomic<std::size_t> dequeue_pos{0};
+};
+
+
+}
+
+#endif //PATTERNS_UTIL_MPMC_QUEUE_HPP
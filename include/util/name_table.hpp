@@ -0,0 +1,234 @@
+#ifndef PATTERNS_UTIL_NAME_TABLE_HPP
+#define PATTERNS_UTIL_NAME_TABLE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace design_patterns {
+
+
+/**
+ * Hash of a registration name, FNV-1a. Hashes chain: the hash of a name
+ * seeded with the hash of a prefix is the hash of the prefixed name.
+ * @param name
+ * @param hash  Hash of the preceding characters, if any
+ * @return
+ */
+constexpr std::uint64_t hash_name(std::string_view name,
+                                  std::uint64_t hash = 14695981039346656037ull)
+{
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/// Interned name of a name_table, the default key is invalid
+struct name_key {
+    std::uint32_t index = 0;
+    std::uint32_t generation = 0;
+};
+
+/**
+ * Next generation of name_table keys, never 0. Generations are unique to a
+ * table and its copies until the counter wraps around.
+ * @return
+ */
+inline std::uint32_t next_name_generation()
+{
+    static std::atomic<std::uint32_t> next{1};
+    std::uint32_t generation;
+    do {
+        generation = next.fetch_add(1, std::memory_order_relaxed);
+    } while (generation==0);
+    return generation;
+}
+
+/**
+ * Open addressing hash table of names, probed linearly. The hash of every
+ * name is stored with it, so lookups by std::string_view allocate nothing
+ * and compare names only on matching hashes. Prefixed names can be looked
+ * up by their two parts, without concatenating them. Names are never
+ * removed one by one, only cleared all together.
+ *
+ * Names can also be interned into a name_key, indexing the mapped values
+ * directly. Values keep their index in copies of the table, so a key stays
+ * valid for every copy, and is invalidated by clear: each clear starts a
+ * new generation of keys. Generations are drawn from a global counter, so
+ * keys of another table are rejected too.
+ * @tparam T    Mapped type
+ */
+template<class T>
+class name_table {
+public:
+    std::size_t size() const
+    {
+        return used;
+    }
+
+    std::size_t count(std::string_view name) const
+    {
+        return find(name) ? 1 : 0;
+    }
+
+    /**
+     * Intern a name
+     * @param name
+     * @return      The key of the name, or an invalid key if not found
+     */
+    name_key key(std::string_view name) const
+    {
+        return key(std::string_view(), name, hash_name(name));
+    }
+
+    /**
+     * Intern a prefixed name
+     * @param prefix
+     * @param name
+     * @param hash  Hash of the prefixed name
+     * @return      The key of the name, or an invalid key if not found
+     */
+    name_key key(std::string_view prefix, std::string_view name,
+                 std::uint64_t hash) const
+    {
+        if (const entry* e = find_entry(prefix, name, hash))
+            return name_key{static_cast<std::uint32_t>(e->index), generation};
+        return name_key{};
+    }
+
+    /**
+     * Find an interned name
+     * @param key
+     * @return      The mapped value, or null if the key is invalid, was
+     *              interned before a clear or by another table
+     */
+    const T* find(name_key key) const
+    {
+        if (key.generation!=generation || key.index>=values.size())
+            return nullptr;
+        return &values[key.index];
+    }
+
+    /**
+     * Find a prefixed name
+     * @param prefix
+     * @param name
+     * @param hash  Hash of the prefixed name
+     * @return      The mapped value, or null if not found
+     */
+    const T* find(std::string_view prefix, std::string_view name,
+                  std::uint64_t hash) const
+    {
+        const entry* e = find_entry(prefix, name, hash);
+        return e ? &values[e->index] : nullptr;
+    }
+
+    const T* find(std::string_view name, std::uint64_t hash) const
+    {
+        return find(std::string_view(), name, hash);
+    }
+
+    const T* find(std::string_view name) const
+    {
+        return find(name, hash_name(name));
+    }
+
+    T* find(std::string_view name)
+    {
+        return const_cast<T*>(std::as_const(*this).find(name));
+    }
+
+    T& at(std::string_view name)
+    {
+        if (T* value = find(name))
+            return *value;
+        throw std::out_of_range("name_table::at: "+std::string(name));
+    }
+
+    /// Mapped value of a name, inserted if not found
+    T& operator[](std::string_view name)
+    {
+        if (T* value = find(name))
+            return *value;
+        if ((used+1)*2>entries.size())
+            rehash(entries.empty() ? 16 : entries.size()*2);
+        entry& e = slot(hash_name(name));
+        e.used = true;
+        e.hash = hash_name(name);
+        e.name = std::string(name);
+        e.index = values.size();
+        values.emplace_back();
+        used++;
+        return values.back();
+    }
+
+    void clear()
+    {
+        entries.clear();
+        values.clear();
+        used = 0;
+        generation = next_name_generation();
+    }
+
+private:
+    struct entry {
+        bool used = false;
+        std::uint64_t hash = 0;
+        std::string name;
+        std::size_t index = 0;
+    };
+
+    std::vector<entry> entries;
+    std::vector<T> values;
+    std::size_t used = 0;
+    std::uint32_t generation = next_name_generation();
+
+    const entry* find_entry(std::string_view prefix, std::string_view name,
+                            std::uint64_t hash) const
+    {
+        if (entries.empty())
+            return nullptr;
+        const std::size_t mask = entries.size()-1;
+        for (std::size_t i = hash & mask; ; i = (i+1) & mask) {
+            const entry& e = entries[i];
+            if (!e.used)
+                return nullptr;
+            if (e.hash==hash &&
+                    e.name.size()==prefix.size()+name.size() &&
+                    e.name.compare(0, prefix.size(), prefix)==0 &&
+                    e.name.compare(prefix.size(), name.size(), name)==0)
+                return &e;
+        }
+    }
+
+    /// First free entry for a hash
+    entry& slot(std::uint64_t hash)
+    {
+        const std::size_t mask = entries.size()-1;
+        std::size_t i = hash & mask;
+        while (entries[i].used)
+            i = (i+1) & mask;
+        return entries[i];
+    }
+
+    void rehash(std::size_t capacity)
+    {
+        std::vector<entry> old(capacity);
+        old.swap(entries);
+        for (auto& e : old) {
+            if (e.used)
+                slot(e.hash) = std::move(e);
+        }
+    }
+};
+
+
+}
+
+#endif //PATTERNS_UTIL_NAME_TABLE_HPP
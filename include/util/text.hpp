@@ -2,10 +2,13 @@
 #define PATTERNS_UTIL_TEXT_HPP
 
 #include <cxxabi.h>
+#include <sstream>
+#include <string>
 #include <typeindex>
+#include <vector>
 
 
-const std::string demangle(const char* name)
+inline const std::string demangle(const char* name)
 {
     int status = -4;
     char* res = abi::__cxa_demangle(name, nullptr, nullptr, &status);
@@ -0,0 +1,219 @@
+#ifndef PATTERNS_UTIL_THREAD_POOL_HPP
+#define PATTERNS_UTIL_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "exception.hpp"
+
+namespace design_patterns {
+
+
+/// Exceptions thrown by the tasks of a parallel run
+class parallel_exception : public design_pattern_exception {
+public:
+    explicit parallel_exception(std::vector<std::exception_ptr> errors)
+            :design_pattern_exception(std::to_string(errors.size())+
+            " parallel task(s) failed"), errors(std::move(errors)) { };
+
+    const std::vector<std::exception_ptr>& exceptions() const
+    {
+        return errors;
+    }
+
+private:
+    std::vector<std::exception_ptr> errors;
+};
+
+/**
+ * Thread pool running index ranges split in chunks. Every worker owns a
+ * queue of chunks, takes from its back and steals from the front of the
+ * others when empty, balancing uneven chunks. The calling thread takes
+ * part as worker 0. One run at a time, runs must not be nested.
+ */
+class work_stealing_pool {
+public:
+    /**
+     * @param workers   Number of workers, including the calling thread
+     */
+    explicit work_stealing_pool(
+            std::size_t workers = std::thread::hardware_concurrency())
+            :queues(std::max<std::size_t>(workers, 1))
+    {
+        for (std::size_t i = 1; i<queues.size(); ++i)
+            threads.emplace_back([this, i]() { work(i); });
+    }
+
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+    ~work_stealing_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    /// Number of workers, including the calling thread
+    std::size_t workers() const
+    {
+        return queues.size();
+    }
+
+    /**
+     * Run fn over [0, count) split in chunks, and wait for all of them
+     * @param count     Number of indexes
+     * @param grain     Indexes per chunk, 0 for 8 chunks per worker
+     * @param fn        Callable with (first, last, worker) of a chunk
+     * @throw parallel_exception with the exceptions of the failed chunks,
+     *        the other chunks run to the end
+     */
+    template<class Fn>
+    void parallel_for(std::size_t count, std::size_t grain, Fn&& fn)
+    {
+        if (count==0)
+            return;
+        if (grain==0)
+            grain = std::max<std::size_t>(1, count/(workers()*8));
+        std::lock_guard<std::mutex> run_lock(run_mtx);
+        const std::size_t chunks = (count+grain-1)/grain;
+        for (std::size_t c = 0; c<chunks; ++c) {
+            auto& q = queues[c%queues.size()];
+            std::lock_guard<std::mutex> lock(q.mtx);
+            q.chunks.push_back({c*grain, std::min(count, (c+1)*grain)});
+        }
+        job current{[&fn](std::size_t first, std::size_t last,
+                          std::size_t worker) {
+          fn(first, last, worker);
+        }, chunks};
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            active = &current;
+            generation++;
+        }
+        wake.notify_all();
+        run(current, 0);
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            done.wait(lock, [&]() {
+              return current.remaining==0 && current.running==0;
+            });
+            active = nullptr;
+        }
+        if (!current.errors.empty())
+            throw parallel_exception(std::move(current.errors));
+    }
+
+private:
+    struct range {
+        std::size_t first;
+        std::size_t last;
+    };
+
+    struct queue {
+        std::mutex mtx;
+        std::deque<range> chunks;
+    };
+
+    struct job {
+        std::function<void(std::size_t, std::size_t, std::size_t)> fn;
+        std::atomic<std::size_t> remaining;
+        // workers inside run, the job outlives them
+        std::size_t running = 0;
+        std::mutex errors_mtx;
+        std::vector<std::exception_ptr> errors;
+
+        job(std::function<void(std::size_t, std::size_t, std::size_t)> fn,
+            std::size_t chunks): fn(std::move(fn)), remaining(chunks) { }
+    };
+
+    bool pop(std::size_t worker, range& chunk)
+    {
+        {
+            auto& own = queues[worker];
+            std::lock_guard<std::mutex> lock(own.mtx);
+            if (!own.chunks.empty()) {
+                chunk = own.chunks.back();
+                own.chunks.pop_back();
+                return true;
+            }
+        }
+        for (std::size_t i = 1; i<queues.size(); ++i) {
+            auto& victim = queues[(worker+i)%queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mtx);
+            if (!victim.chunks.empty()) {
+                chunk = victim.chunks.front();
+                victim.chunks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(job& current, std::size_t worker)
+    {
+        range chunk{};
+        while (pop(worker, chunk)) {
+            try {
+                current.fn(chunk.first, chunk.last, worker);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(current.errors_mtx);
+                current.errors.push_back(std::current_exception());
+            }
+            current.remaining--;
+        }
+    }
+
+    void work(std::size_t worker)
+    {
+        std::size_t seen = 0;
+        std::unique_lock<std::mutex> lock(mtx);
+        for (;;) {
+            wake.wait(lock, [&]() {
+              return stopping || (active && generation!=seen);
+            });
+            if (stopping)
+                return;
+            seen = generation;
+            job& current = *active;
+            current.running++;
+            lock.unlock();
+            run(current, worker);
+            lock.lock();
+            current.running--;
+            if (current.remaining==0 && current.running==0)
+                done.notify_all();
+        }
+    }
+
+    std::vector<queue> queues;
+    std::vector<std::thread> threads;
+    std::mutex run_mtx;
+    std::mutex mtx;
+    std::condition_variable wake;
+    std::condition_variable done;
+    job* active = nullptr;
+    std::size_t generation = 0;
+    bool stopping = false;
+};
+
+
+}
+
+#endif //PATTERNS_UTIL_THREAD_POOL_HPP
@@ -29,4 +29,14 @@ using is_not_smart_ptr = typename std::enable_if<
                 is_unique_ptr<T>::value==false,T>;
 
 
+/// Type of a parameter excluded from template argument deduction
+template<typename T>
+struct type_identity {
+    using type = T;
+};
+
+template<typename T>
+using type_identity_t = typename type_identity<T>::type;
+
+
 #endif //PATTERNS_UTIL_TYPES_HPP
\ No newline at end of file
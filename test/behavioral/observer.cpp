@@ -1,3 +1,11 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "behavioral/observer.hpp"
 
@@ -101,6 +109,559 @@ TEST(DessignPatternObserverTest, Notify)
 
 }
 
+TEST(DessignPatternObserverTest, Subscription)
+{
+    auto observer1 = dpb::make_observer<my_observer>();
+    auto observer2 = dpb::make_observer<my_observer>();
+    auto observer3 = dpb::make_observer<my_observer>();
+    my_observable observable;
+
+    auto sub1 = observable.add_observer(observer1);
+    auto sub2 = observable.add_observer(observer2);
+    auto sub3 = observable.add_observer(observer3);
+    auto again = observable.add_observer(observer2);
+    ASSERT_EQ(again.index, sub2.index);
+    ASSERT_EQ(again.generation, sub2.generation);
+    ASSERT_EQ(observable.count_observers(), 3);
+
+    ASSERT_TRUE(observable.remove_observer(sub1));
+    ASSERT_FALSE(observable.remove_observer(sub1));
+    ASSERT_FALSE(observable.contains(sub1));
+    ASSERT_TRUE(observable.contains(sub3));
+
+    // the slot is reused with a new generation
+    auto sub4 = observable.add_observer(observer1);
+    ASSERT_EQ(sub4.index, sub1.index);
+    ASSERT_FALSE(observable.remove_observer(sub1));
+    ASSERT_EQ(observable.count_observers(), 3);
+
+    notification1 n1;
+    observable.notify(n1);
+    ASSERT_TRUE(observer1->notified1);
+    ASSERT_TRUE(observer3->notified1);
+
+    observer3.reset();
+    ASSERT_EQ(observable.prune(), 1);
+    ASSERT_FALSE(observable.contains(sub3));
+    ASSERT_EQ(observable.count_observers(), 2);
+}
+
+struct counted {
+    int value;
+};
+
+class counting_observer : public dpb::observer<counted> {
+public:
+    std::atomic<int> count{0};
+    std::atomic<int> last{0};
+    void handle(counted& notification) override
+    {
+        count++;
+        last = notification.value;
+    }
+};
+
+TEST(DessignPatternObserverTest, AsyncNotify)
+{
+    auto observer = dpb::make_observer<counting_observer>();
+    {
+        dpb::async_observable<counting_observer> observable(4, 2);
+        observable.add_observer(observer);
+        std::vector<std::thread> producers;
+        for (int p = 0; p<4; ++p) {
+            producers.emplace_back([&]() {
+              for (int i = 0; i<1000; ++i)
+                  observable.notify(counted{i});
+            });
+        }
+        for (auto& producer : producers)
+            producer.join();
+        observable.flush();
+        ASSERT_EQ(observer->count, 4000);
+        ASSERT_EQ(observable.dropped(), 0);
+    }
+
+    // without dispatchers, delivered by drain
+    observer->count = 0;
+    dpb::async_observable<counting_observer> newest(2, 0,
+            dpb::backpressure::drop_newest);
+    newest.add_observer(observer);
+    ASSERT_TRUE(newest.notify(counted{1}));
+    ASSERT_TRUE(newest.notify(counted{2}));
+    ASSERT_FALSE(newest.notify(counted{3}));
+    ASSERT_EQ(newest.drain(), 2);
+    ASSERT_EQ(observer->last, 2);
+    ASSERT_EQ(newest.dropped(), 1);
+
+    dpb::async_observable<counting_observer> oldest(2, 0,
+            dpb::backpressure::drop_oldest);
+    oldest.add_observer(observer);
+    for (int i = 1; i<=3; ++i)
+        oldest.notify(counted{i});
+    oldest.flush();
+    ASSERT_EQ(observer->last, 3);
+    ASSERT_EQ(oldest.dropped(), 1);
+    ASSERT_EQ(observer->count, 4);
+
+    // observers released by their owner while dispatchers deliver to them
+    dpb::async_observable<counting_observer> released(64, 2);
+    observer->count = 0;
+    released.add_observer(observer);
+    for (int i = 0; i<200; ++i) {
+        std::shared_ptr<counting_observer> transient(new counting_observer);
+        released.add_observer(transient);
+        released.notify(counted{i});
+        released.notify(counted{i});
+    }
+    released.flush();
+    ASSERT_EQ(observer->count, 400);
+}
+
+class throwing_observer : public dpb::observer<counted> {
+public:
+    void handle(counted&) override
+    {
+        throw std::runtime_error("failed");
+    }
+};
+
+class payload_observer
+        : public dpb::observer<std::string, std::array<int, 64>> {
+public:
+    std::atomic<int> sum{0};
+    void handle(std::string& notification) override
+    {
+        sum += static_cast<int>(notification.size());
+    }
+    void handle(std::array<int, 64>& notification) override
+    {
+        sum += notification[63];
+    }
+};
+
+TEST(DessignPatternObserverTest, AsyncNotifyErrors)
+{
+    auto counter = dpb::make_observer<counting_observer>();
+    auto thrower = dpb::make_observer<throwing_observer>();
+    std::atomic<int> handled{0};
+    {
+        dpb::async_observable<dpb::observer<counted>> dispatched(8, 2);
+        dispatched.add_observer(thrower);
+        dispatched.add_observer(counter);
+        dispatched.set_error_handler([&](std::exception_ptr error) {
+          try {
+              std::rethrow_exception(error);
+          }
+          catch (std::runtime_error&) {
+              handled++;
+          }
+        });
+        for (int i = 0; i<100; ++i)
+            dispatched.notify(counted{i});
+        dispatched.flush();
+        ASSERT_EQ(counter->count, 100);
+        ASSERT_EQ(dispatched.errors(), 100);
+        ASSERT_EQ(handled, 100);
+    }
+
+    // delivered by flush without dispatchers, errors only counted
+    counter->count = 0;
+    dpb::async_observable<dpb::observer<counted>> drained(8, 0);
+    drained.add_observer(thrower);
+    drained.add_observer(counter);
+    for (int i = 0; i<3; ++i)
+        drained.notify(counted{i});
+    drained.flush();
+    ASSERT_EQ(counter->count, 3);
+    ASSERT_EQ(drained.errors(), 3);
+
+    // a producer blocked on a full queue is woken by drain
+    counter->count = 0;
+    dpb::async_observable<counting_observer> blocking(2, 0);
+    blocking.add_observer(counter);
+    std::thread producer([&]() {
+      for (int i = 0; i<100; ++i)
+          blocking.notify(counted{i});
+    });
+    while (counter->count<100)
+        blocking.drain();
+    producer.join();
+
+    // notifications stored in the queue cells and allocated
+    auto payload = dpb::make_observer<payload_observer>();
+    {
+        dpb::async_observable<payload_observer> stored(4, 1);
+        stored.add_observer(payload);
+        std::array<int, 64> large{};
+        large[63] = 10;
+        for (int i = 0; i<10; ++i) {
+            stored.notify(std::string(100, 'x'));
+            stored.notify(large);
+        }
+        stored.flush();
+    }
+    ASSERT_EQ(payload->sum, 1100);
+}
+
+TEST(DessignPatternObserverTest, ConcurrentNotify)
+{
+    dpb::concurrent_observable<counting_observer> observable;
+    auto stable = dpb::make_observer<counting_observer>();
+    observable.add_observer(stable);
+
+    std::atomic<bool> done{false};
+    std::atomic<std::size_t> most_snapshots{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t<3; ++t) {
+        threads.emplace_back([&]() {
+          for (int i = 0; i<2000; ++i) {
+              counted notification{i};
+              observable.notify(notification);
+              std::size_t seen = most_snapshots;
+              const std::size_t live = observable.snapshots();
+              while (live>seen && !most_snapshots.compare_exchange_weak(
+                      seen, live)) { }
+          }
+        });
+    }
+    // subscriptions churn, observers expire while notified
+    threads.emplace_back([&]() {
+      while (!done) {
+          auto transient = dpb::make_observer<counting_observer>();
+          auto sub = observable.add_observer(transient);
+          auto expiring = dpb::make_observer<counting_observer>();
+          observable.add_observer(expiring);
+          expiring.reset();
+          observable.remove_observer(sub);
+          observable.prune();
+      }
+    });
+    for (int t = 0; t<3; ++t)
+        threads[t].join();
+    done = true;
+    threads.back().join();
+
+    ASSERT_EQ(stable->count, 6000);
+    // the current one, one per notifier and one being published
+    ASSERT_LE(most_snapshots, 5);
+    ASSERT_EQ(observable.snapshots(), 1);
+    observable.prune();
+    ASSERT_EQ(observable.count_observers(), 1);
+}
+
+/// Subscribes another observer and notifies again from handle
+class resubscribing_observer : public dpb::observer<counted> {
+public:
+    dpb::concurrent_observable<dpb::observer<counted>>* target = nullptr;
+    std::shared_ptr<counting_observer> extra;
+    void handle(counted& notification) override
+    {
+        if (notification.value!=0)
+            return;
+        target->add_observer(extra);
+        counted nested{1};
+        target->notify(nested);
+    }
+};
+
+TEST(DessignPatternObserverTest, ConcurrentNotifyNested)
+{
+    auto stable = dpb::make_observer<counting_observer>();
+    auto nesting = dpb::make_observer<resubscribing_observer>();
+    nesting->extra = dpb::make_observer<counting_observer>();
+    {
+        dpb::concurrent_observable<dpb::observer<counted>> observable;
+        nesting->target = &observable;
+        observable.add_observer(nesting);
+        observable.add_observer(stable);
+
+        // the outer loop keeps the snapshot replaced by the nested notify
+        counted notification{0};
+        observable.notify(notification);
+        ASSERT_EQ(stable->count, 2);
+        ASSERT_EQ(nesting->extra->count, 1);
+        observable.notify(notification);
+        ASSERT_EQ(nesting->extra->count, 3);
+        // this thread keeps the snapshot replaced by the nested add
+        ASSERT_EQ(observable.snapshots(), 2);
+        counted refresh{2};
+        observable.notify(refresh);
+        ASSERT_EQ(observable.snapshots(), 1);
+    }
+    // the snapshot cached by this thread outlives the observable
+    std::thread([&]() {
+      dpb::concurrent_observable<dpb::observer<counted>> other;
+      other.add_observer(stable);
+      counted notification{2};
+      other.notify(notification);
+    }).join();
+    ASSERT_EQ(stable->count, 6);
+}
+
+/// Releases its last owner from handle, then uses its members
+class releasing_observer : public dpb::observer<counted> {
+public:
+    std::shared_ptr<releasing_observer> self;
+    std::vector<int> values;
+    void handle(counted& notification) override
+    {
+        self.reset();
+        values.push_back(notification.value);
+    }
+};
+
+TEST(DessignPatternObserverTest, NotifyReleasedObserver)
+{
+    dpb::observable<releasing_observer> observable;
+    // allocated apart from the control block, freed with the last owner
+    std::shared_ptr<releasing_observer> observer(new releasing_observer);
+    observer->self = observer;
+    std::weak_ptr<releasing_observer> reference = observer;
+    observable.add_observer(observer);
+    observer.reset();
+
+    counted notification{1};
+    observable.notify(notification);
+    // pinned by the observable until the next notification prunes it
+    ASSERT_FALSE(reference.expired());
+    ASSERT_EQ(observable.count_observers(), 1);
+    observable.notify(notification);
+    ASSERT_TRUE(reference.expired());
+    ASSERT_EQ(observable.count_observers(), 0);
+}
+
+class failing_observer : public counting_observer {
+public:
+    void handle(counted& notification) override
+    {
+        counting_observer::handle(notification);
+        throw std::runtime_error("failing_observer");
+    }
+};
+
+TEST(DessignPatternObserverTest, NotifyParallel)
+{
+    design_patterns::work_stealing_pool pool(4);
+    dpb::observable<counting_observer> observable;
+    std::vector<std::shared_ptr<counting_observer>> observers;
+    for (int i = 0; i<1000; ++i) {
+        observers.push_back(dpb::make_observer<counting_observer>());
+        observable.add_observer(observers.back());
+    }
+    counted notification{1};
+    observable.notify_parallel(pool, notification, 16);
+    observable.notify_parallel(pool, notification);
+    for (auto& o : observers)
+        ASSERT_EQ(o->count, 2);
+
+    observers[10].reset();
+    auto failing1 = dpb::make_observer<failing_observer>();
+    auto failing2 = dpb::make_observer<failing_observer>();
+    observable.add_observer(failing1);
+    observable.add_observer(failing2);
+    try {
+        observable.notify_parallel(pool, notification, 16);
+        FAIL();
+    }
+    catch (design_patterns::parallel_exception& e) {
+        ASSERT_EQ(e.exceptions().size(), 2);
+    }
+    ASSERT_EQ(failing1->count, 1);
+    ASSERT_EQ(failing2->count, 1);
+    ASSERT_EQ(observers.back()->count, 3);
+    ASSERT_EQ(observable.count_observers(), 1001);
+
+    // observers released by their handler on the workers
+    dpb::observable<releasing_observer> releasing;
+    for (int i = 0; i<100; ++i) {
+        auto observer = dpb::make_observer<releasing_observer>();
+        observer->self = observer;
+        releasing.add_observer(observer);
+    }
+    releasing.notify_parallel(pool, notification, 16);
+    releasing.notify_parallel(pool, notification, 16);
+    ASSERT_EQ(releasing.count_observers(), 0);
+}
+
+struct quote {
+    int symbol;
+    int price;
+};
+
+/// Only handles quotes
+class quote_observer {
+public:
+    int count = 0;
+    int last = 0;
+    void handle(quote& notification)
+    {
+        count++;
+        last = notification.price;
+    }
+};
+
+/// Handles quotes and counts
+class quote_counting_observer : public quote_observer {
+public:
+    using quote_observer::handle;
+    void handle(counted&)
+    {
+        count++;
+    }
+};
+
+TEST(DessignPatternObserverTest, TopicNotify)
+{
+    dpb::topic_observable<counted, quote> observable;
+    auto all = dpb::make_observer<quote_observer>();
+    auto symbol1 = dpb::make_observer<quote_observer>();
+    auto other = dpb::make_observer<counting_observer>();
+    auto sub_all = observable.subscribe<quote>(all);
+    observable.subscribe<quote>(symbol1, [](const quote& q) {
+      return q.symbol==1;
+    });
+    auto sub_other = observable.subscribe<counted>(other);
+    ASSERT_EQ(observable.count_subscribers<quote>(), 2);
+    ASSERT_EQ(observable.count_subscribers(), 3);
+
+    quote q1{1, 10};
+    quote q2{2, 20};
+    observable.notify(q1);
+    observable.notify(q2);
+    ASSERT_EQ(all->count, 2);
+    ASSERT_EQ(all->last, 20);
+    ASSERT_EQ(symbol1->count, 1);
+    ASSERT_EQ(symbol1->last, 10);
+    ASSERT_EQ(other->count, 0);
+
+    counted c{5};
+    observable.notify(c);
+    ASSERT_EQ(other->count, 1);
+
+    ASSERT_TRUE(observable.unsubscribe<quote>(sub_all));
+    ASSERT_FALSE(observable.unsubscribe<quote>(sub_all));
+    ASSERT_TRUE(observable.contains<counted>(sub_other));
+
+    symbol1.reset();
+    observable.notify(q1);
+    ASSERT_EQ(observable.count_subscribers<quote>(), 0);
+    ASSERT_EQ(all->count, 2);
+
+    // released by its handler
+    auto releasing = dpb::make_observer<releasing_observer>();
+    releasing->self = releasing;
+    observable.subscribe<counted>(releasing);
+    releasing.reset();
+    observable.notify(c);
+    observable.notify(c);
+    ASSERT_EQ(observable.count_subscribers<counted>(), 1);
+
+    // one pin shared by the subscriptions of an observer
+    auto both = dpb::make_observer<quote_counting_observer>();
+    std::weak_ptr<quote_counting_observer> reference = both;
+    observable.subscribe<quote>(both);
+    observable.subscribe<counted>(both);
+    observable.notify(q1);
+    both.reset();
+    observable.notify(q1);
+    ASSERT_EQ(observable.count_subscribers<quote>(), 0);
+    ASSERT_FALSE(reference.expired());
+    observable.notify(c);
+    ASSERT_EQ(observable.count_subscribers<counted>(), 1);
+    ASSERT_TRUE(reference.expired());
+}
+
+class batch_observer : public dpb::observer<quote> {
+public:
+    std::vector<std::vector<int>> batches;
+    void handle(quote& notification) override
+    {
+        batches.push_back({notification.price});
+    }
+
+    void handle_batch(quote* notifications, std::size_t count) override
+    {
+        batches.emplace_back();
+        for (std::size_t i = 0; i<count; ++i)
+            batches.back().push_back(notifications[i].price);
+    }
+};
+
+/// Batches quotes only, the default handle_batch of counted stays visible
+class partial_batch_observer : public dpb::observer<counted, quote> {
+public:
+    using dpb::observer<counted, quote>::handle_batch;
+    int handled = 0;
+    int batches = 0;
+    void handle(counted&) override { handled++; }
+    void handle(quote&) override { handled++; }
+    void handle_batch(quote*, std::size_t) override { batches++; }
+};
+
+TEST(DessignPatternObserverTest, NotifyBatch)
+{
+    auto observer = dpb::make_observer<counting_observer>();
+    dpb::observable<counting_observer> observable;
+    observable.add_observer(observer);
+    std::vector<counted> notifications{{1}, {2}, {3}};
+    observable.notify_batch(notifications.data(), notifications.size());
+    ASSERT_EQ(observer->count, 3);
+    ASSERT_EQ(observer->last, 3);
+
+    auto batches = dpb::make_observer<batch_observer>();
+    dpb::observable<batch_observer> quotes;
+    quotes.add_observer(batches);
+    {
+        dpb::coalescing_notifier<batch_observer, quote, int> notifier(quotes,
+                [](const quote& q) { return q.symbol; });
+        notifier.notify(quote{1, 10});
+        notifier.notify(quote{2, 20});
+        notifier.notify(quote{1, 11});
+        ASSERT_EQ(notifier.size(), 2);
+        ASSERT_EQ(notifier.coalesced(), 1);
+        ASSERT_TRUE(batches->batches.empty());
+        ASSERT_EQ(notifier.flush(), 2);
+        ASSERT_EQ(notifier.flush(), 0);
+        notifier.notify(quote{2, 21});
+    }
+    ASSERT_EQ(batches->batches.size(), 2);
+    ASSERT_EQ(batches->batches[0], std::vector<int>({11, 20}));
+    ASSERT_EQ(batches->batches[1], std::vector<int>({21}));
+
+    // an elapsed window flushes on notify
+    dpb::coalescing_notifier<batch_observer, quote, int> windowed(quotes,
+            [](const quote& q) { return q.symbol; },
+            std::chrono::milliseconds(1));
+    windowed.notify(quote{1, 30});
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    windowed.notify(quote{1, 31});
+    ASSERT_EQ(windowed.size(), 0);
+    ASSERT_EQ(batches->batches.size(), 3);
+    ASSERT_EQ(batches->batches[2], std::vector<int>({31}));
+
+    auto partial = dpb::make_observer<partial_batch_observer>();
+    dpb::observable<partial_batch_observer> mixed;
+    mixed.add_observer(partial);
+    std::vector<quote> run{{1, 1}, {2, 2}};
+    mixed.notify_batch(notifications.data(), notifications.size());
+    mixed.notify_batch(run.data(), run.size());
+    ASSERT_EQ(partial->handled, 3);
+    ASSERT_EQ(partial->batches, 1);
+
+    // released by its handler in the middle of the run
+    auto releasing = dpb::make_observer<releasing_observer>();
+    releasing->self = releasing;
+    dpb::observable<releasing_observer> released;
+    released.add_observer(releasing);
+    std::weak_ptr<releasing_observer> reference = releasing;
+    releasing.reset();
+    released.notify_batch(notifications.data(), notifications.size());
+    ASSERT_FALSE(reference.expired());
+    released.notify_batch(notifications.data(), notifications.size());
+    ASSERT_TRUE(reference.expired());
+    ASSERT_EQ(released.count_observers(), 0);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
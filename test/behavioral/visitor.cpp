@@ -126,6 +126,115 @@ TEST(DessignPatternVisitorTest, VisitorFactoryMethod)
     ASSERT_TRUE(visitor4->called_params_constructor);
 }
 
+TEST(DessignPatternVisitorTest, VisitByTypeIndex)
+{
+    my_visitor visitor;
+    my_visitable_a visitable_a;
+    my_visitable_b visitable_b;
+    ASSERT_EQ(visitable_a.type_index(), 0);
+    ASSERT_EQ(visitable_b.type_index(), 1);
+
+    std::vector<dpb::visitable_base<my_visitable_a, my_visitable_b>*>
+            visitables = {&visitable_a, &visitable_b, &visitable_b};
+    for (auto visitable : visitables)
+        dpb::visit(visitor, *visitable);
+    ASSERT_EQ(visitor.visitedA, 1);
+    ASSERT_EQ(visitor.visitedB, 2);
+    // accept is bypassed
+    ASSERT_EQ(visitable_b.accepted, 0);
+
+    int visited_a = 0;
+    int visited_b = 0;
+    struct counter {
+        int& a;
+        int& b;
+        void operator()(my_visitable_a&) { a++; }
+        void operator()(my_visitable_b&) { b++; }
+    };
+    for (auto visitable : visitables)
+        dpb::visit(counter{visited_a, visited_b}, *visitable);
+    ASSERT_EQ(visited_a, 1);
+    ASSERT_EQ(visited_b, 2);
+}
+
+TEST(DessignPatternVisitorTest, VisitBatched)
+{
+    my_visitable_a visitable_a1, visitable_a2;
+    my_visitable_b visitable_b1, visitable_b2;
+    std::vector<dpb::visitable_base<my_visitable_a, my_visitable_b>*>
+            visitables = {&visitable_b1, &visitable_a1, &visitable_b2,
+                          &visitable_a2};
+
+    dpb::visit_batch<my_visitable_a, my_visitable_b> batch(
+            visitables.begin(), visitables.end());
+    ASSERT_EQ(batch.size(), 4);
+    ASSERT_EQ(batch.size(0), 2);
+    ASSERT_EQ(batch.size(1), 2);
+
+    std::vector<void*> visited;
+    auto record = [&](auto& visitable) { visited.push_back(&visitable); };
+    batch.visit(record);
+    std::vector<void*> by_type = {&visitable_a1, &visitable_a2,
+                                  &visitable_b1, &visitable_b2};
+    ASSERT_EQ(visited, by_type);
+
+    visited.clear();
+    batch.visit(record, dpb::visit_order::original);
+    std::vector<void*> original = {&visitable_b1, &visitable_a1,
+                                   &visitable_b2, &visitable_a2};
+    ASSERT_EQ(visited, original);
+
+    my_visitor visitor;
+    dpb::visit_batched(visitor, visitables.begin(), visitables.end());
+    ASSERT_EQ(visitor.visitedA, 2);
+    ASSERT_EQ(visitor.visitedB, 2);
+}
+
+TEST(DessignPatternVisitorTest, VisitParallel)
+{
+    std::vector<my_visitable_a> as(1000);
+    std::vector<my_visitable_b> bs(500);
+    std::vector<dpb::visitable_base<my_visitable_a, my_visitable_b>*>
+            visitables;
+    for (std::size_t i = 0; i<as.size(); ++i) {
+        visitables.push_back(&as[i]);
+        if (i<bs.size())
+            visitables.push_back(&bs[i]);
+    }
+
+    struct counter : public dpb::visitor<my_visitable_a, my_visitable_b> {
+        int a = 0;
+        int b = 0;
+        void visit(my_visitable_a&) override { a++; }
+        void visit(my_visitable_b&) override { b++; }
+    };
+    design_patterns::work_stealing_pool pool(4);
+    int made = 0;
+    auto totals = dpb::visit_parallel(pool, visitables.begin(),
+            visitables.end(),
+            [&]() { made++; return dpb::make_visitor<counter>(); },
+            std::make_pair(0, 0),
+            [](std::pair<int, int> total, counter& visitor) {
+              return std::make_pair(total.first+visitor.a,
+                      total.second+visitor.b);
+            });
+    ASSERT_EQ(made, 4);
+    ASSERT_EQ(totals.first, 1000);
+    ASSERT_EQ(totals.second, 500);
+
+    // visitors by value, failed visits are reported once all ran
+    struct failing {
+        int visited = 0;
+        void operator()(my_visitable_a&) { visited++; }
+        void operator()(my_visitable_b&) { throw std::runtime_error("b"); }
+    };
+    EXPECT_THROW(dpb::visit_parallel(pool, visitables.begin(),
+            visitables.end(), []() { return failing(); }, 0,
+            [](int total, failing& visitor) {
+              return total+visitor.visited;
+            }), design_patterns::parallel_exception);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -103,6 +103,32 @@ TEST(DessignPatternAbstractFactoryTest, AbstractFactoryCreate)
     assert_equal_types<big_sofa>(sofa1);
 }
 
+TEST(DessignPatternAbstractFactoryTest, AbstractFactoryDispatch)
+{
+    furniture_factory ff;
+    EXPECT_THROW({
+        ff.create("bed", "big");
+    }, dpc::factory_create_exception);
+
+    auto table = ff.dispatch();
+    EXPECT_EQ(table.families(), 3);
+    EXPECT_EQ(table.products(), 5);
+    auto chair1 = table.create(table.resolve("chair", "old"));
+    assert_equal_types<old_chair>(chair1);
+    auto sofa1 = table.create(table.family("sofa"), table.product("small"));
+    assert_equal_types<small_sofa>(sofa1);
+    auto table1 = table.create(table.family("table"), table.product("old"));
+    assert_equal_types<old_table>(table1);
+
+    // not registered by the family, or not with the signature
+    EXPECT_THROW(table.resolve("sofa", "old"), dpc::factory_create_exception);
+    EXPECT_THROW(table.resolve("bed", "old"), dpc::factory_create_exception);
+    auto int_table = ff.dispatch<int>();
+    EXPECT_NO_THROW(int_table.resolve("chair", "fancy"));
+    EXPECT_THROW(int_table.resolve("chair", "old"),
+            dpc::factory_create_exception);
+}
+
 TEST(DessignPatternAbstractFactoryTest, AlreadyRegistered)
 {
     table_factory tf;
@@ -112,6 +138,22 @@ TEST(DessignPatternAbstractFactoryTest, AlreadyRegistered)
     }, dpc::factory_exception);
 }
 
+TEST(DessignPatternAbstractFactoryTest, FactoryCreate)
+{
+    chair_factory cf;
+    const std::string message = "create old chairs";
+    auto chair1 = cf.create(std::string_view(message.data()+7, 3));
+    assert_equal_types<old_chair>(chair1);
+    auto chair2 = cf.create("fancy", 1);
+    assert_equal_types<fancy_chair>(chair2);
+
+    // registered by another factory
+    sofa_factory sf;
+    EXPECT_THROW({
+        cf.create("big");
+    }, dpc::factory_create_exception);
+}
+
 
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
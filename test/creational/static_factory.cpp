@@ -1,5 +1,10 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "creational/factory.hpp"
+#include "static_registration.hpp"
 
 namespace dpc = design_patterns::creational;
 
@@ -13,6 +18,24 @@ struct my_derived_class : public my_base_class {
   explicit my_derived_class(double val1, int val2) { }
 };
 
+TEST(DessignPatternFactoryTest, FactoryStaticRegistration)
+{
+    typedef dpc::static_factory<static_base> factory;
+    ASSERT_TRUE(static_registered);
+    ASSERT_EQ(factory::registered(), 1u);
+    auto obj = factory::create("static_derived");
+    ASSERT_NE(dynamic_cast<static_derived*>(obj.get()), nullptr);
+
+    // later registrations keep the static one
+    factory::register_type<static_other>("static_other");
+    ASSERT_EQ(factory::registered(), 2u);
+    ASSERT_NE(factory::try_create("static_derived"), nullptr);
+    ASSERT_NE(factory::try_create("static_other"), nullptr);
+    EXPECT_THROW({
+        factory::register_type<static_derived>("static_derived");
+    }, dpc::factory_exception);
+}
+
 TEST(DessignPatternFactoryTest, FactoryRegistration)
 {
     auto fac = dpc::static_factory<my_base_class>::get_instance(true);
@@ -73,6 +96,26 @@ TEST(DessignPatternFactoryTest, FactoryCreate)
 
 }
 
+TEST(DessignPatternFactoryTest, FactoryConcurrentRegistration)
+{
+    auto fac = dpc::static_factory<my_base_class>::get_instance(true);
+    std::atomic<int> registered{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t<4; ++t) {
+        threads.emplace_back([&]() {
+          try {
+              fac.register_type<my_derived_class, int>("my_derived_class");
+              registered++;
+          }
+          catch (dpc::factory_exception&) { }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    ASSERT_EQ(registered, 1);
+    ASSERT_EQ(fac.registered("my_derived_class"), 1);
+}
+
 TEST(DessignPatternFactoryTest, FactoryCreateException)
 {
     auto fac = dpc::static_factory<my_base_class>::get_instance(true);
@@ -83,6 +126,246 @@ TEST(DessignPatternFactoryTest, FactoryCreateException)
     }, dpc::factory_create_exception);
 }
 
+TEST(DessignPatternFactoryTest, FactoryTryCreate)
+{
+    auto fac = dpc::static_factory<my_base_class>::get_instance(true);
+    for (int i = 0; i<100; ++i)
+        fac.register_type<my_derived_class, int>("type_"+std::to_string(i));
+
+    const std::string message = "create type_42 now";
+    std::string_view name(message.data()+7, 7);
+    EXPECT_NE(fac.try_create(name, 1), nullptr);
+    EXPECT_NE(fac.create(name, 1), nullptr);
+    EXPECT_EQ(fac.try_create("type_100", 1), nullptr);
+    EXPECT_EQ(fac.try_create(name), nullptr);
+    for (int i = 0; i<100; ++i)
+        EXPECT_NE(fac.try_create("type_"+std::to_string(i), 1), nullptr);
+}
+
+TEST(DessignPatternFactoryTest, FactoryConcurrentCreate)
+{
+    auto fac = dpc::static_factory<my_base_class>::get_instance(true);
+    fac.register_type<my_derived_class, int>("my_derived_class");
+
+    std::atomic<int> created{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t<4; ++t) {
+        threads.emplace_back([&]() {
+          for (int i = 0; i<10000; ++i) {
+              if (fac.try_create("my_derived_class", i))
+                  created++;
+          }
+        });
+    }
+    // registrations publish new tables while creating
+    for (int i = 0; i<100; ++i)
+        fac.register_type<my_derived_class, int>("type_"+std::to_string(i));
+    for (auto& thread : threads)
+        thread.join();
+
+    EXPECT_EQ(created, 40000);
+    EXPECT_NE(fac.try_create("type_99", 1), nullptr);
+}
+
+TEST(DessignPatternFactoryTest, FactoryCreateByKey)
+{
+    auto fac = dpc::static_factory<my_base_class>::get_instance(true);
+    fac.register_type<my_derived_class, int>("my_derived_class");
+    fac.register_type<my_derived_class, float, int>("my_derived_class");
+
+    auto key = fac.key<float, int>("my_derived_class");
+    std::vector<std::thread> threads;
+    std::atomic<int> created{0};
+    for (int t = 0; t<4; ++t) {
+        threads.emplace_back([&]() {
+          if (fac.create(key, 1.5f, 1))
+              created++;
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    EXPECT_EQ(created, 4);
+    EXPECT_EQ(fac.try_create(fac.key<int>("undefined"), 1), nullptr);
+
+    // keys do not survive clear, even if the name is registered again
+    fac.clear();
+    fac.register_type<my_derived_class, float, int>("my_derived_class");
+    EXPECT_EQ(fac.try_create(key, 1.5f, 1), nullptr);
+    EXPECT_THROW({
+        fac.create(key, 1.5f, 1);
+    }, dpc::factory_create_exception);
+    EXPECT_NE(fac.create(fac.key<float, int>("my_derived_class"), 1.5f, 1),
+            nullptr);
+}
+
+struct my_message {
+    virtual ~my_message() = default;
+};
+
+struct my_text_message : public my_message {
+    explicit my_text_message(int id): id(id) { }
+    int id;
+};
+
+TEST(DessignPatternFactoryTest, FactoryPooledCreate)
+{
+    auto fac = dpc::static_factory<my_message>::get_instance(true);
+    fac.register_pooled<my_text_message, int>("text", 4);
+
+    auto obj1 = fac.create("text", 1);
+    my_message* storage = obj1.get();
+    ASSERT_EQ(static_cast<my_text_message*>(storage)->id, 1);
+    obj1.reset();
+
+    // the storage of the destroyed product is recycled
+    auto obj2 = fac.create("text", 2);
+    EXPECT_EQ(obj2.get(), storage);
+    EXPECT_EQ(static_cast<my_text_message*>(obj2.get())->id, 2);
+}
+
+TEST(DessignPatternFactoryTest, FactoryCreateBatch)
+{
+    auto fac = dpc::static_factory<my_message>::get_instance(true);
+    fac.register_type<my_text_message, int>("text");
+
+    auto products = fac.create_n("text", 3, 7);
+    ASSERT_EQ(products.size(), 3);
+    for (auto& obj : products)
+        EXPECT_EQ(static_cast<my_text_message*>(obj.get())->id, 7);
+
+    std::vector<std::unique_ptr<my_message>> out(2);
+    fac.create_batch("text", out.begin(), out.end(), 8);
+    EXPECT_EQ(static_cast<my_text_message*>(out[1].get())->id, 8);
+
+    auto block = fac.create_contiguous("text", 4, 9);
+    ASSERT_EQ(block.size(), 4);
+    EXPECT_EQ(static_cast<my_text_message&>(block[3]).id, 9);
+    EXPECT_EQ(reinterpret_cast<char*>(&block[1]),
+            reinterpret_cast<char*>(&block[0])+sizeof(my_text_message));
+
+    EXPECT_THROW(fac.create_n("unknown", 2, 1), dpc::factory_create_exception);
+    EXPECT_THROW(fac.create_contiguous("text", 2, 1.5f),
+            dpc::factory_create_exception);
+}
+
+struct my_other_message : public my_message {
+    explicit my_other_message(double value): value(value) { }
+    double value;
+};
+
+TEST(DessignPatternFactoryTest, PolyVectorCreate)
+{
+    auto fac = dpc::static_factory<my_message>::get_instance(true);
+    fac.register_type<my_text_message, int>("text");
+
+    dpc::poly_vector<my_message> products;
+    products.create_n("text", 20, 1);
+    products.emplace<my_other_message>(2.5);
+    products.create("text", 2);
+    ASSERT_EQ(products.size(), 22);
+    EXPECT_EQ(products.types(), 2);
+    EXPECT_EQ(products.size<my_text_message>(), 21);
+
+    // grouped by type, in order of construction within a type
+    std::size_t n = 0;
+    for (auto& obj : products) {
+        if (n<21) {
+            EXPECT_EQ(static_cast<my_text_message&>(obj).id, n<20 ? 1 : 2);
+        }
+        n++;
+    }
+    EXPECT_EQ(n, 22);
+
+    double sum = 0;
+    products.for_each<my_other_message>([&](my_other_message& obj) {
+      sum += obj.value;
+    });
+    EXPECT_EQ(sum, 2.5);
+
+    EXPECT_THROW(products.create("unknown", 1), dpc::factory_create_exception);
+    EXPECT_EQ(products.size(), 22);
+    products.clear();
+    EXPECT_TRUE(products.empty());
+    EXPECT_EQ(products.begin(), products.end());
+}
+
+static constexpr char derived_name[] = "my_derived_class";
+static constexpr char other_name[] = "my_other_class";
+
+struct my_other_class : public my_base_class {
+  explicit my_other_class(int) { }
+};
+
+typedef dpc::constexpr_factory<my_base_class,
+        dpc::factory_entry<my_derived_class, derived_name>,
+        dpc::factory_entry<my_other_class, other_name>> my_constexpr_factory;
+
+TEST(DessignPatternFactoryTest, ConstexprFactoryCreate)
+{
+    auto& fac = my_constexpr_factory::get_instance();
+    static_assert(my_constexpr_factory::registered()==2);
+    static_assert(my_constexpr_factory::registered("my_other_class")==1);
+    static_assert(my_constexpr_factory::registered("undefined")==0);
+
+    auto obj1 = fac.create("my_derived_class");
+    auto obj2 = fac.create("my_derived_class", 2.3f, 1);
+    auto obj3 = fac.create(std::string("my_other_class"), 1);
+    EXPECT_NE(obj3, nullptr);
+    EXPECT_EQ(fac.try_create("my_other_class"), nullptr);
+    EXPECT_EQ(fac.try_create("undefined", 1), nullptr);
+
+    EXPECT_THROW({
+        auto obj4 = fac.create("my_other_class", 2.3f, 1);
+    }, dpc::factory_create_exception);
+}
+
+static constexpr char first_name[] = "first";
+static constexpr char second_name[] = "second";
+static constexpr char third_name[] = "third";
+
+typedef dpc::constexpr_factory<static_base,
+        dpc::factory_entry<static_derived, first_name>,
+        dpc::factory_entry<static_other, second_name>,
+        dpc::factory_entry<static_derived, second_name>,
+        dpc::factory_entry<static_other, third_name>> shared_name_factory;
+
+TEST(DessignPatternFactoryTest, ConstexprFactorySharedName)
+{
+    static_assert(shared_name_factory::registered("second")==2);
+
+    auto first = shared_name_factory::create("first");
+    EXPECT_NE(dynamic_cast<static_derived*>(first.get()), nullptr);
+    // the first registration of a name wins
+    auto second = shared_name_factory::create("second");
+    EXPECT_NE(dynamic_cast<static_other*>(second.get()), nullptr);
+    auto third = shared_name_factory::create("third");
+    EXPECT_NE(dynamic_cast<static_other*>(third.get()), nullptr);
+    EXPECT_EQ(shared_name_factory::try_create("fourth"), nullptr);
+    EXPECT_EQ(shared_name_factory::try_create("first", 1), nullptr);
+}
+
+static std::vector<std::string> logged;
+
+void capture_sink(const design_patterns::log::record& rec)
+{
+    if (rec.event==design_patterns::log::event::registered)
+        logged.push_back(std::string(rec.component)+": "+rec.message);
+}
+
+TEST(DessignPatternFactoryTest, FactoryLogSink)
+{
+    auto fac = dpc::static_factory<my_base_class>::get_instance(true);
+    auto previous = design_patterns::log::set_sink(&capture_sink);
+    fac.register_type<my_derived_class>("my_derived_class");
+    design_patterns::log::set_sink(nullptr);
+    fac.register_type<my_derived_class, int>("my_derived_class");
+    design_patterns::log::set_sink(previous);
+
+    ASSERT_EQ(logged.size(), 1u);
+    EXPECT_EQ(logged[0].find("static_factory: "), 0u);
+    EXPECT_NE(logged[0].find("my_derived_class"), std::string::npos);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,12 @@
+#include "creational/static_factory.hpp"
+#include "static_registration.hpp"
+
+namespace dpc = design_patterns::creational;
+
+// registered during static initialization, before the factory statics are
+// used by any other translation unit
+const bool static_registered = []() {
+  dpc::static_factory<static_base>::register_type<static_derived>(
+          "static_derived");
+  return true;
+}();
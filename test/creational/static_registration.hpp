@@ -0,0 +1,15 @@
+#ifndef PATTERNS_TEST_STATIC_REGISTRATION_HPP
+#define PATTERNS_TEST_STATIC_REGISTRATION_HPP
+
+struct static_base {
+    virtual ~static_base() = default;
+};
+
+struct static_derived : public static_base {};
+
+struct static_other : public static_base {};
+
+/// Registered from a static initializer in its own translation unit
+extern const bool static_registered;
+
+#endif //PATTERNS_TEST_STATIC_REGISTRATION_HPP
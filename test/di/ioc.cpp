@@ -1,3 +1,8 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
 #include "gtest/gtest.h"
 #include "di/ioc.hpp"
 
@@ -50,6 +55,99 @@ private:
     std::unique_ptr<InterfaceA> b_unique;
 };
 
+class counted {
+public:
+    static int instances;
+    counted() { instances++; }
+    virtual ~counted() { instances--; }
+};
+int counted::instances = 0;
+
+class counted_consumer {
+public:
+    explicit counted_consumer(std::shared_ptr<counted> c): c(std::move(c)) { }
+    std::shared_ptr<counted> c;
+};
+
+class holder {
+public:
+    explicit holder(std::shared_ptr<counted> c): c(std::move(c)) { }
+    std::shared_ptr<counted> c;
+};
+
+// cyclic dependency through singletons
+class pong;
+class ping {
+public:
+    explicit ping(std::shared_ptr<pong> p): p(std::move(p)) { }
+    std::shared_ptr<pong> p;
+};
+class pong {
+public:
+    explicit pong(std::shared_ptr<ping> p): p(std::move(p)) { }
+    std::shared_ptr<ping> p;
+};
+
+// counts the allocations made while resolving
+static std::atomic<std::size_t> allocations{0};
+
+void* operator new(std::size_t size)
+{
+    allocations++;
+    if (void* ptr = std::malloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+[[gnu::noinline]] void operator delete(void* ptr) noexcept { std::free(ptr); }
+[[gnu::noinline]] void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+// short names keep demangled type names in the small string buffer
+class svc {
+public:
+    virtual ~svc() = default;
+};
+
+// move only
+class impl: public svc {
+public:
+    impl() = default;
+    impl(impl&&) = default;
+    impl(const impl&) = delete;
+    std::unique_ptr<int> state;
+};
+
+class user {
+public:
+    user(std::unique_ptr<svc> u, std::shared_ptr<svc> s, impl v)
+            : u(std::move(u)), s(std::move(s)), v(std::move(v)) { }
+    std::unique_ptr<svc> u;
+    std::shared_ptr<svc> s;
+    impl v;
+};
+
+template<class T, class _Resolver>
+std::size_t count_allocations(_Resolver& resolver)
+{
+    std::size_t before = allocations;
+    T obj = resolver.template resolve<T>();
+    std::size_t count = allocations-before;
+    if constexpr (std::is_pointer<T>::value)
+        delete obj;
+    return count;
+}
+
+template<class _Resolver>
+void expect_single_allocations(_Resolver& resolver)
+{
+    EXPECT_EQ(count_allocations<std::shared_ptr<svc>>(resolver), 1u);
+    EXPECT_EQ(count_allocations<std::unique_ptr<svc>>(resolver), 1u);
+    EXPECT_EQ(count_allocations<svc*>(resolver), 1u);
+    EXPECT_EQ(count_allocations<impl>(resolver), 0u);
+    // the user and its pointer arguments, the impl argument is built in place
+    EXPECT_EQ(count_allocations<std::shared_ptr<user>>(resolver), 3u);
+    EXPECT_EQ(count_allocations<std::unique_ptr<user>>(resolver), 3u);
+}
+
 
 TEST(DessignPatternIOCTest, Register)
 {
@@ -83,8 +181,371 @@ TEST(DessignPatternIOCTest, CyclicDependency)
 
 }
 
+TEST(DessignPatternIOCTest, CompiledResolve)
+{
+    di::ioc_container container;
+
+    container.register_type<C>();
+    container.register_type<InterfaceA, A, C, C*>();
+    container.register_type<InterfaceB,
+                            B,
+                            std::shared_ptr<InterfaceA>,
+                            std::unique_ptr<InterfaceA>>();
+    container.compile();
+    ASSERT_TRUE(container.is_compiled());
+
+    auto resolved = container.resolve<std::shared_ptr<InterfaceB>>();
+    ASSERT_NE(resolved, nullptr);
+
+    // registering discards the compiled plans
+    container.register_type<InterfaceA, A, C, C*>();
+    ASSERT_TRUE(container.is_compiled());
+    container.register_type<int>(std::function<int*()>([]() {
+        return new int(0);
+    }));
+    ASSERT_FALSE(container.is_compiled());
+}
+
+TEST(DessignPatternIOCTest, CompileCyclicDependency)
+{
+    di::ioc_container container;
+
+    container.register_type<C>();
+    container.register_type<InterfaceA, A, C, C*, std::shared_ptr<InterfaceB>>();
+    container.register_type<InterfaceB,
+                            B,
+                            std::shared_ptr<InterfaceA>,
+                            std::unique_ptr<InterfaceA>>();
+    try {
+        container.compile();
+        FAIL() << "Expected di::ioc_cycle_exception";
+    }
+    catch (di::ioc_cycle_exception& ex) {
+        const std::string msg = ex.what();
+        EXPECT_TRUE(msg.find("InterfaceA -> InterfaceB -> InterfaceA")!=std::string::npos ||
+                    msg.find("InterfaceB -> InterfaceA -> InterfaceB")!=std::string::npos)
+                            << msg;
+    }
+    ASSERT_FALSE(container.is_compiled());
+}
+
+TEST(DessignPatternIOCTest, CompileSingletonCyclicDependency)
+{
+    di::ioc_container container;
+
+    container.register_type<ping, ping, std::shared_ptr<pong>>(
+            di::lifetime::singleton);
+    container.register_type<pong, pong, std::shared_ptr<ping>>(
+            di::lifetime::singleton);
+    try {
+        container.compile();
+        FAIL() << "Expected di::ioc_cycle_exception";
+    }
+    catch (di::ioc_cycle_exception& ex) {
+        const std::string msg = ex.what();
+        EXPECT_TRUE(msg.find("ping -> pong -> ping")!=std::string::npos ||
+                    msg.find("pong -> ping -> pong")!=std::string::npos)
+                            << msg;
+    }
+    ASSERT_FALSE(container.is_compiled());
+}
+
+TEST(DessignPatternIOCTest, CompileUnregisteredDependency)
+{
+    di::ioc_container container;
+
+    container.register_type<InterfaceA, A, C, C*>();
+    EXPECT_THROW({
+        container.compile();
+    }, di::ioc_exception);
+}
+
+TEST(DessignPatternIOCTest, SnapshotConcurrentResolve)
+{
+    di::ioc_container container;
+
+    container.register_type<C>();
+    container.register_type<InterfaceA, A, C, C*>();
+    container.register_type<InterfaceB,
+                            B,
+                            std::shared_ptr<InterfaceA>,
+                            std::unique_ptr<InterfaceA>>();
+    const di::ioc_snapshot snapshot = container.freeze();
+    ASSERT_TRUE(container.is_compiled());
+
+    // later registrations do not change the snapshot
+    container.register_type<int>(std::function<int*()>([]() {
+        return new int(0);
+    }));
+    EXPECT_THROW({
+        snapshot.resolve<int*>();
+    }, std::runtime_error);
+
+    std::atomic<int> resolved{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t<4; ++t) {
+        threads.emplace_back([&]() {
+          for (int i = 0; i<100; ++i) {
+              if (snapshot.resolve<std::shared_ptr<InterfaceB>>())
+                  resolved++;
+          }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    ASSERT_EQ(resolved, 400);
+}
+
+TEST(DessignPatternIOCTest, SingletonLifetime)
+{
+    di::ioc_container container;
+
+    container.register_type<counted>(di::lifetime::singleton);
+    container.register_type<counted_consumer,
+                            counted_consumer,
+                            std::shared_ptr<counted>>();
+
+    auto c1 = container.resolve<std::shared_ptr<counted>>();
+    auto c2 = container.resolve<std::shared_ptr<counted>>();
+    ASSERT_EQ(c1, c2);
+    ASSERT_EQ(container.resolve<counted*>(), c1.get());
+
+    // snapshots share the container singletons
+    auto snapshot = container.freeze();
+    ASSERT_EQ(snapshot.resolve<std::shared_ptr<counted>>(), c1);
+    ASSERT_EQ(snapshot.resolve<counted_consumer*>()->c, c1);
+    ASSERT_EQ(counted::instances, 1);
+
+    EXPECT_THROW({
+        container.resolve<std::unique_ptr<counted>>();
+    }, di::ioc_exception);
+}
+
+TEST(DessignPatternIOCTest, SingletonConcurrentResolve)
+{
+    di::ioc_container container;
+
+    const int instances = counted::instances;
+    container.register_type<counted>(di::lifetime::singleton);
+    counted* singleton = container.resolve<counted*>();
+
+    // built singletons are resolved while other threads register and resolve
+    std::atomic<int> resolved{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t<4; ++t) {
+        threads.emplace_back([&]() {
+          for (int i = 0; i<100; ++i) {
+              if (container.resolve<std::shared_ptr<counted>>().get()==singleton)
+                  resolved++;
+          }
+        });
+    }
+    container.register_type<counted_consumer,
+                            counted_consumer,
+                            std::shared_ptr<counted>>();
+    for (int i = 0; i<100; ++i)
+        delete container.resolve<counted_consumer*>();
+    for (auto& thread : threads)
+        thread.join();
+    ASSERT_EQ(resolved, 400);
+    ASSERT_EQ(counted::instances, instances+1);
+}
+
+TEST(DessignPatternIOCTest, PerThreadLifetime)
+{
+    di::ioc_container container;
+
+    container.register_type<counted>(di::lifetime::per_thread);
+    auto snapshot = container.freeze();
+
+    counted* main_thread = snapshot.resolve<counted*>();
+    ASSERT_EQ(snapshot.resolve<counted*>(), main_thread);
+
+    counted* other_thread = nullptr;
+    std::thread([&]() {
+      other_thread = snapshot.resolve<counted*>();
+      ASSERT_EQ(snapshot.resolve<counted*>(), other_thread);
+    }).join();
+    ASSERT_NE(other_thread, nullptr);
+    ASSERT_NE(main_thread, other_thread);
+}
+
+TEST(DessignPatternIOCTest, ScopedLifetime)
+{
+    const int instances = counted::instances;
+    di::ioc_container container;
+
+    container.register_type<counted>(di::lifetime::scoped);
+    container.register_type<counted_consumer,
+                            counted_consumer,
+                            std::shared_ptr<counted>>();
+    EXPECT_THROW({
+        container.resolve<counted*>();
+    }, di::ioc_exception);
+
+    auto snapshot = container.freeze();
+    {
+        di::ioc_scope scope1(snapshot);
+        di::ioc_scope scope2(snapshot);
+        counted* c1 = scope1.resolve<counted*>();
+        std::unique_ptr<counted_consumer> consumer(
+                scope1.resolve<counted_consumer*>());
+        ASSERT_EQ(consumer->c.get(), c1);
+        ASSERT_NE(scope2.resolve<counted*>(), c1);
+        ASSERT_EQ(counted::instances, instances+2);
+    }
+    // scoped instances are destroyed with their scope
+    ASSERT_EQ(counted::instances, instances);
+}
+
+TEST(DessignPatternIOCTest, ResolveById)
+{
+    di::ioc_container container;
+
+    container.register_type<C>("my_c", std::function<C*()>([]() {
+        return new C();
+    }));
+
+    std::unique_ptr<C> resolved(container.resolve<C>("my_c"));
+    ASSERT_NE(resolved, nullptr);
+    EXPECT_THROW({
+        container.resolve<C>("undefined");
+    }, std::runtime_error);
+}
+
+TEST(DessignPatternIOCTest, ResolveByKey)
+{
+    di::ioc_container container;
+
+    container.register_type<C>("my_c", std::function<C*()>([]() {
+        return new C();
+    }));
+
+    di::ioc_key key = container.key("my_c");
+    std::unique_ptr<C> resolved(container.resolve<C>(key));
+    ASSERT_NE(resolved, nullptr);
+    std::unique_ptr<C> snapshot_resolved(container.freeze().resolve<C>(key));
+    ASSERT_NE(snapshot_resolved, nullptr);
+    EXPECT_THROW({
+        container.resolve<C>(container.key("undefined"));
+    }, std::runtime_error);
+
+    // keys of another container are rejected, not resolved by index
+    di::ioc_container other;
+    other.register_type<int>("my_int", std::function<int*()>([]() {
+        return new int(0);
+    }));
+    di::ioc_key other_key = other.key("my_int");
+    ASSERT_EQ(other_key.index, key.index);
+    EXPECT_THROW({
+        container.resolve<C>(other_key);
+    }, std::runtime_error);
+    EXPECT_THROW({
+        container.freeze().resolve<C>(other_key);
+    }, std::runtime_error);
+}
+
+TEST(DessignPatternIOCTest, ResolveTypeIdRegistration)
+{
+    di::ioc_container container;
+
+    // registered by type_info, resolved by type through the string keyed map
+    container.register_type<A>(&typeid(InterfaceA),
+            std::function<A*()>([]() { return new A(C(), nullptr); }));
+
+    std::shared_ptr<InterfaceA> resolved = container.resolve<std::shared_ptr<InterfaceA>>();
+    ASSERT_NE(resolved, nullptr);
+
+    // registered by type, resolved by the name of its typeid
+    container.register_type<C>();
+    container.register_type<counted>(di::lifetime::singleton);
+    std::unique_ptr<C> by_name(container.resolve<C>(typeid(C).name()));
+    ASSERT_NE(by_name, nullptr);
+    di::ioc_key key = container.key(typeid(counted).name());
+    counted* singleton = container.resolve<counted>(key);
+    ASSERT_EQ(singleton, container.resolve<counted*>());
+    ASSERT_EQ(container.freeze().resolve<counted>(key), singleton);
+}
+
+TEST(DessignPatternIOCTest, SnapshotNamedResolve)
+{
+    auto container = std::make_unique<di::ioc_container>();
+
+    container->register_type<counted>(di::lifetime::singleton);
+    container->register_type<counted_consumer, counted_consumer,
+                             std::shared_ptr<counted>>();
+    const di::ioc_snapshot snapshot = container->freeze();
+    const di::ioc_key key = container->key(typeid(counted).name());
+
+    // named entries of the snapshot do not call back into the container
+    std::atomic<int> resolved{0};
+    std::thread by_container([&]() {
+      for (int i = 0; i<100; ++i) {
+          std::unique_ptr<counted_consumer> consumer(container->resolve<
+                  counted_consumer>(typeid(counted_consumer).name()));
+          if (consumer)
+              resolved++;
+      }
+    });
+    for (int i = 0; i<100; ++i) {
+        std::unique_ptr<counted_consumer> consumer(snapshot.resolve<
+                counted_consumer>(typeid(counted_consumer).name()));
+        if (consumer && consumer->c.get()==snapshot.resolve<counted>(key))
+            resolved++;
+    }
+    by_container.join();
+    ASSERT_EQ(resolved, 200);
+
+    counted* singleton = snapshot.resolve<counted>(key);
+    container.reset();
+    std::unique_ptr<counted_consumer> consumer(snapshot.resolve<
+            counted_consumer>(typeid(counted_consumer).name()));
+    ASSERT_NE(consumer, nullptr);
+    ASSERT_EQ(consumer->c.get(), singleton);
+    ASSERT_EQ(snapshot.resolve<counted>(typeid(counted).name()), singleton);
+    ASSERT_EQ(snapshot.resolve<counted>(key), singleton);
+}
+
+
+TEST(DessignPatternIOCTest, SingleAllocationResolve)
+{
+    di::ioc_container container;
+    container.register_type<svc, impl>();
+    container.register_type<impl>();
+    container.register_type<user, user, std::unique_ptr<svc>,
+                            std::shared_ptr<svc>, impl>();
+
+    expect_single_allocations(container);
+    container.compile();
+    expect_single_allocations(container);
+    di::ioc_snapshot snapshot = container.freeze();
+    expect_single_allocations(snapshot);
+}
+
+TEST(DessignPatternIOCTest, ArenaScope)
+{
+    di::ioc_container container;
+    container.register_type<counted>();
+    container.register_type<holder, holder, std::shared_ptr<counted>>();
+    di::ioc_snapshot snapshot = container.freeze();
+    int instances = counted::instances;
+    {
+        di::ioc_scope scope(snapshot, 4096);
+        scope.resolve<std::shared_ptr<holder>>();
+        std::size_t before = allocations;
+        auto consumer = scope.resolve<std::shared_ptr<holder>>();
+        counted* raw = scope.resolve<counted*>();
+        EXPECT_EQ(allocations-before, 0u);
+        EXPECT_NE(raw, consumer->c.get());
+        EXPECT_EQ(counted::instances, instances+2);
+    }
+    // raw pointers are owned by the scope
+    EXPECT_EQ(counted::instances, instances);
+}
 
 int main(int argc, char **argv) {
+    // no log formatting while counting allocations
+    design_patterns::log::set_sink(nullptr);
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
 }